@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+// Multi-threaded malloc/free churn. Each thread keeps a table of live
+// blocks and replaces a random one per step, so blocks live for a while
+// and sizes mix; a share of the blocks is handed to the next thread to
+// free, as producer/consumer services do. Run under different allocators
+// with LD_PRELOAD (see run_alloc_bench.sh).
+// Usage: alloc_bench [threads] [steps-per-thread] [max-size]
+
+#define SLOTS 4096
+#define HANDOFF 64          // blocks passed to the next thread at a time
+
+struct worker {
+    pthread_t thread;
+    int id;
+    long steps;
+    size_t max_size;
+    pthread_mutex_t lock;
+    void *inbox[HANDOFF * 4];   // blocks other threads want this one to free
+    int inbox_count;
+};
+
+static struct worker *workers;
+static int thread_count;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Mostly small sizes, the way real programs allocate, with a long tail
+static size_t pick_size(uint64_t *state, size_t max_size) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    uint64_t r = *state;
+    size_t size = (r % 100) < 80 ? 8 + (r >> 8) % 120 : (r % 100) < 98 ? 128 + (r >> 8) % 4096 : (r >> 8) % max_size;
+    return size ? size : 1;
+}
+
+static void hand_off(struct worker *to, void **blocks, int count) {
+    pthread_mutex_lock(&to->lock);
+    int room = (int)(sizeof(to->inbox) / sizeof(to->inbox[0])) - to->inbox_count;
+    int n = count < room ? count : room;
+    memcpy(to->inbox + to->inbox_count, blocks, n * sizeof(void *));
+    to->inbox_count += n;
+    pthread_mutex_unlock(&to->lock);
+    // A full inbox means the neighbour is behind; free the rest here
+    for (int i = n; i < count; i++) free(blocks[i]);
+}
+
+static void drain_inbox(struct worker *self) {
+    void *mine[HANDOFF * 4];
+    pthread_mutex_lock(&self->lock);
+    int n = self->inbox_count;
+    memcpy(mine, self->inbox, n * sizeof(void *));
+    self->inbox_count = 0;
+    pthread_mutex_unlock(&self->lock);
+    for (int i = 0; i < n; i++) free(mine[i]);
+}
+
+static void *run(void *arg) {
+    struct worker *self = arg;
+    struct worker *next = &workers[(self->id + 1) % thread_count];
+    void **slots = calloc(SLOTS, sizeof(void *));
+    void *outgoing[HANDOFF];
+    int out_count = 0;
+    uint64_t state = 0x9e3779b97f4a7c15ULL * (self->id + 1);
+
+    for (long step = 0; step < self->steps; step++) {
+        size_t index = (state >> 20) % SLOTS;
+        if (slots[index]) {
+            if (thread_count > 1 && step % 8 == 0) {
+                outgoing[out_count++] = slots[index];
+                if (out_count == HANDOFF) {
+                    hand_off(next, outgoing, out_count);
+                    out_count = 0;
+                }
+            } else {
+                free(slots[index]);
+            }
+        }
+        size_t size = pick_size(&state, self->max_size);
+        slots[index] = malloc(size);
+        // Touch it, as a real user would
+        ((char *)slots[index])[0] = 1;
+        ((char *)slots[index])[size - 1] = 1;
+        if (step % 1024 == 0) drain_inbox(self);
+    }
+
+    for (int i = 0; i < SLOTS; i++) free(slots[i]);
+    for (int i = 0; i < out_count; i++) free(outgoing[i]);
+    drain_inbox(self);
+    free(slots);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    thread_count = argc > 1 ? atoi(argv[1]) : 4;
+    long steps = argc > 2 ? atol(argv[2]) : 2000000;
+    size_t max_size = argc > 3 ? strtoul(argv[3], NULL, 10) : 256 * 1024;
+    if (thread_count < 1 || steps < 1 || max_size < 1) {
+        fprintf(stderr, "Usage: %s [threads] [steps-per-thread] [max-size]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    workers = calloc(thread_count, sizeof(*workers));
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].id = i;
+        workers[i].steps = steps;
+        workers[i].max_size = max_size;
+        pthread_mutex_init(&workers[i].lock, NULL);
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, run, &workers[i]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    // Leftover handoffs from threads that finished before their neighbour
+    for (int i = 0; i < thread_count; i++) drain_inbox(&workers[i]);
+
+    double ops = 2.0 * steps * thread_count;
+    printf("threads %d\n", thread_count);
+    printf("wall_ns %lu\n", elapsed);
+    printf("ns_per_op %.1f\n", elapsed / ops);
+    printf("mops_per_s %.2f\n", ops / elapsed * 1000);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("maxrss_kb %ld\n", usage.ru_maxrss);
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef ALLOCTRACE_H
+#define ALLOCTRACE_H
+
+#include <stdint.h>
+
+// Trace file written by sharedlib.so and read by alloctrace_report: a
+// struct trace_header, then struct trace_record until the end of the file.
+// Records from different threads are interleaved in the order they were
+// drained, not by time.
+
+#define TRACE_MAGIC 0x43525441     // "ATRC"
+#define TRACE_VERSION 1
+
+enum trace_op {
+    TRACE_MALLOC = 1,
+    TRACE_CALLOC,
+    TRACE_REALLOC,      // `old` was resized to `size` bytes at `ptr`
+    TRACE_FREE,
+    TRACE_DROPPED,      // `size` records of thread `tid` were lost to a full ring
+};
+
+struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t pid;
+};
+
+struct trace_record {
+    uint64_t ns;        // CLOCK_MONOTONIC
+    uint64_t ptr;
+    uint64_t old;
+    uint64_t size;
+    uint32_t tid;
+    uint32_t op;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "alloctrace.h"
+
+// Summarize a trace written by sharedlib.so: operation counts and rates,
+// a power-of-two size histogram, live bytes over time and a per-thread
+// breakdown.
+
+#define SIZE_CLASSES 48
+#define MAX_THREADS 1024
+
+struct thread_count {
+    uint32_t tid;
+    uint64_t allocs, frees, bytes;
+};
+
+// Live blocks by address, open addressing with tombstones
+struct live_table {
+    uint64_t *ptrs;             // 0 is empty, 1 is a tombstone
+    uint64_t *sizes;
+    size_t mask;
+    size_t used;                // slots that aren't empty
+    size_t blocks;              // live entries
+};
+
+static uint64_t hash_ptr(uint64_t p) {
+    p ^= p >> 33;
+    p *= 0xff51afd7ed558ccdULL;
+    return p ^ (p >> 33);
+}
+
+static void live_init(struct live_table *t, size_t capacity) {
+    t->mask = capacity - 1;
+    t->used = 0;
+    t->blocks = 0;
+    t->ptrs = calloc(capacity, sizeof(uint64_t));
+    t->sizes = calloc(capacity, sizeof(uint64_t));
+    if (!t->ptrs || !t->sizes) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t live_insert(struct live_table *t, uint64_t ptr, uint64_t size);
+
+static void live_grow(struct live_table *t) {
+    struct live_table old = *t;
+    live_init(t, (old.mask + 1) * 2);
+    for (size_t i = 0; i <= old.mask; i++) {
+        if (old.ptrs[i] > 1) live_insert(t, old.ptrs[i], old.sizes[i]);
+    }
+    free(old.ptrs);
+    free(old.sizes);
+}
+
+// Returns the size of an entry for `ptr` this replaces (its free was lost)
+static uint64_t live_insert(struct live_table *t, uint64_t ptr, uint64_t size) {
+    if (2 * (t->used + 1) > t->mask + 1) live_grow(t);
+    size_t i = hash_ptr(ptr) & t->mask, slot = SIZE_MAX;
+    while (t->ptrs[i] != 0 && t->ptrs[i] != ptr) {
+        if (t->ptrs[i] == 1 && slot == SIZE_MAX) slot = i;
+        i = (i + 1) & t->mask;
+    }
+    uint64_t replaced = 0;
+    if (t->ptrs[i] == ptr) {
+        slot = i;
+        replaced = t->sizes[i];
+    } else {
+        t->blocks++;
+        if (slot == SIZE_MAX) {
+            slot = i;
+            t->used++;
+        }
+    }
+    t->ptrs[slot] = ptr;
+    t->sizes[slot] = size;
+    return replaced;
+}
+
+// Remove `ptr` and return its size, or 0 if it wasn't live (allocated
+// before tracing started, say)
+static uint64_t live_remove(struct live_table *t, uint64_t ptr) {
+    size_t i = hash_ptr(ptr) & t->mask;
+    while (t->ptrs[i] != 0) {
+        if (t->ptrs[i] == ptr) {
+            t->ptrs[i] = 1;
+            t->blocks--;
+            return t->sizes[i];
+        }
+        i = (i + 1) & t->mask;
+    }
+    return 0;
+}
+
+static int compare_time(const void *a, const void *b) {
+    const struct trace_record *x = a, *y = b;
+    return (x->ns > y->ns) - (x->ns < y->ns);
+}
+
+static int size_class(uint64_t size) {
+    int c = 0;
+    while (c < SIZE_CLASSES - 1 && (1ULL << c) < size) c++;
+    return c;
+}
+
+static struct thread_count *thread_of(struct thread_count *threads, int *count, uint32_t tid) {
+    for (int i = 0; i < *count; i++) {
+        if (threads[i].tid == tid) return &threads[i];
+    }
+    if (*count == MAX_THREADS) return NULL;
+    threads[*count].tid = tid;
+    return &threads[(*count)++];
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace-file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        perror(argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        exit(EXIT_FAILURE);
+    }
+
+    struct trace_header header;
+    if (st.st_size < sizeof(header) || read(fd, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != TRACE_MAGIC || header.version != TRACE_VERSION ||
+        header.record_size != sizeof(struct trace_record)) {
+        fprintf(stderr, "%s: not an allocation trace.\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Copied rather than mapped: records are sorted in place
+    size_t count = (st.st_size - sizeof(header)) / sizeof(struct trace_record);
+    struct trace_record *records = malloc(count * sizeof(struct trace_record) + 1);
+    if (!records || pread(fd, records, count * sizeof(struct trace_record), sizeof(header)) !=
+                        (ssize_t)(count * sizeof(struct trace_record))) {
+        perror("read");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    // Rings are drained one after another; put the threads back in step
+    qsort(records, count, sizeof(struct trace_record), compare_time);
+
+    uint64_t ops[TRACE_DROPPED + 1] = { 0 };
+    uint64_t histogram[SIZE_CLASSES] = { 0 };
+    uint64_t allocated = 0, live = 0, peak = 0, dropped = 0, first = 0, last = 0;
+    static struct thread_count threads[MAX_THREADS];
+    int thread_count = 0;
+    struct live_table table;
+    live_init(&table, 1 << 16);
+
+    for (size_t i = 0; i < count; i++) {
+        const struct trace_record *rec = &records[i];
+        if (rec->op == TRACE_DROPPED) {
+            dropped += rec->size;
+            continue;
+        }
+        if (rec->op < TRACE_MALLOC || rec->op > TRACE_FREE) continue;
+        ops[rec->op]++;
+        if (!first) first = rec->ns;
+        last = rec->ns;
+
+        struct thread_count *thread = thread_of(threads, &thread_count, rec->tid);
+        if (rec->op == TRACE_FREE || (rec->op == TRACE_REALLOC && rec->old)) {
+            live -= live_remove(&table, rec->old ? rec->old : rec->ptr);
+            if (thread && rec->op == TRACE_FREE) thread->frees++;
+        }
+        if (rec->op != TRACE_FREE && rec->ptr) {
+            live += rec->size - live_insert(&table, rec->ptr, rec->size);
+            allocated += rec->size;
+            histogram[size_class(rec->size)]++;
+            if (live > peak) peak = live;
+            if (thread) {
+                thread->allocs++;
+                thread->bytes += rec->size;
+            }
+        }
+    }
+
+    double seconds = (last - first) / 1e9;
+    uint64_t allocs = ops[TRACE_MALLOC] + ops[TRACE_CALLOC] + ops[TRACE_REALLOC];
+    printf("%s: pid %u, %zu records over %.3f s\n", argv[1], header.pid, count, seconds);
+    printf("malloc %lu  calloc %lu  realloc %lu  free %lu  dropped %lu\n", ops[TRACE_MALLOC],
+           ops[TRACE_CALLOC], ops[TRACE_REALLOC], ops[TRACE_FREE], dropped);
+    if (seconds > 0) {
+        printf("rate: %.0f allocations/s, %.1f MiB/s allocated\n", allocs / seconds,
+               allocated / seconds / (1 << 20));
+    }
+    printf("allocated %lu bytes, peak live %lu bytes, live at exit %lu bytes in %zu blocks\n", allocated, peak,
+           live, table.blocks);
+
+    printf("\n%12s %12s %7s\n", "size <=", "count", "share");
+    for (int c = 0; c < SIZE_CLASSES; c++) {
+        if (!histogram[c]) continue;
+        int bar = allocs ? 40 * histogram[c] / allocs : 0;
+        printf("%12llu %12lu %6.1f%% %.*s\n", 1ULL << c, histogram[c], 100.0 * histogram[c] / allocs, bar,
+               "########################################");
+    }
+
+    printf("\n%8s %12s %12s %14s\n", "tid", "allocs", "frees", "bytes");
+    for (int i = 0; i < thread_count; i++) {
+        printf("%8u %12lu %12lu %14lu\n", threads[i].tid, threads[i].allocs, threads[i].frees, threads[i].bytes);
+    }
+    return 0;
+}
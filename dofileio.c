@@ -6,9 +6,12 @@
 #include <time.h>
 #include <stdint.h>
 #include <string.h>
+#include "replay.h"
+#include "durable.h"
 
 #define IO_SIZE 4096
 #define FILE_SIZE (1024 * 1024 * 1024) // 1GB
+#define DURABLE_RECORDS 4096
 
 void shuffle(uint64_t* array, size_t n) {
     if (n > 1) {
@@ -40,16 +43,64 @@ void do_file_io(int fd, char *buf, uint64_t *offset_array, size_t n, int opt_rea
     }
 }
 
+static void usage(const char *name) {
+    printf("Usage: %s <path_to_file> <mode>\n", name);
+    printf("       %s <path_to_file> 5 <trace> [workers] [fast|timed] [threads|uring]\n", name);
+    printf("       %s <path_to_file> 6 <sync> [every_n] [every_us] [writers] [records]\n", name);
+    printf("Mode: 1 - Sequential Read, 2 - Sequential Write, 3 - Random Read, 4 - Random Write, "
+           "5 - Replay an iotrace.so trace, 6 - Durable Write\n");
+    printf("Sync: fsync, fdatasync, dsync (O_DSYNC), rwf_dsync, sync_file_range\n");
+    exit(1);
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        printf("Usage: %s <path_to_file> <mode>\n", argv[0]);
-        printf("Mode: 1 - Sequential Read, 2 - Sequential Write, 3 - Random Read, 4 - Random Write\n");
-        exit(1);
+    if (argc < 3 || (atoi(argv[2]) >= 5 ? argc < 4 || argc > 8 : argc != 3)) {
+        usage(argv[0]);
     }
 
     char* path = argv[1];
     int mode = atoi(argv[2]);
 
+    // Replay reissues the traced lengths, which needn't suit O_DIRECT
+    if (mode == 5) {
+        struct replay_options options = { REPLAY_THREADS, 1, 0 };
+        if (argc > 4) options.workers = atoi(argv[4]);
+        if (argc > 5) options.timed = strcmp(argv[5], "timed") == 0;
+        if (argc > 6) options.engine = strcmp(argv[6], "uring") == 0 ? REPLAY_URING : REPLAY_THREADS;
+        if (options.workers < 1) options.workers = 1;
+
+        int fd = open(path, O_RDWR);
+        if (fd == -1) {
+            perror("open");
+            exit(-1);
+        }
+        replay(fd, argv[3], &options);
+        close(fd);
+        return 0;
+    }
+
+    // Appends to a log, truncating it first; syncs are what is measured
+    if (mode == 6) {
+        struct durable_options options = { 0, 1, 0, 1, DURABLE_RECORDS, IO_SIZE };
+        // The enum is unsigned, so check for -1 before storing it
+        int method = sync_method_named(argv[3]);
+        if (method < 0) {
+            usage(argv[0]);
+        }
+        options.method = method;
+        if (argc > 4) options.batch = atoi(argv[4]);
+        if (argc > 5) options.interval_us = atoi(argv[5]);
+        if (argc > 6) options.writers = atoi(argv[6]);
+        if (argc > 7) options.records = atoi(argv[7]);
+        if (options.batch < 0 || options.interval_us < 0 || options.writers < 1 ||
+            options.records < 1) {
+            printf("Bad durable write arguments\n");
+            exit(1);
+        }
+        durable_writes(path, &options);
+        return 0;
+    }
+
     int fd;
     int flags = O_DIRECT; // For Direct IO
 
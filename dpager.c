@@ -9,37 +9,36 @@
 #include <sys/stat.h>
 #include <elf.h>
 #include <signal.h>
+#include "loader.h"
+#include "stats.h"
+#include "plan.h"
+#include "hugetext.h"
 
-#define PAGE_SIZE 4096
-#define STACK_SIZE (1024 * 1024)  // 1MB
-#define MAX_PHDR_COUNT 16
-
-int program_fd = -1;
-Elf64_Phdr phdr_table[MAX_PHDR_COUNT];
-int phdr_count = 0;
-Elf64_Addr entry_point;
+struct elf_image images[2];
+int image_count = 0;
+struct load_info program_info;
 
 void segfault_handler(int sig, siginfo_t *info, void *context) {
     void *fault_addr = info->si_addr;
-    void *aligned_addr = (void *)((uintptr_t)fault_addr & ~(PAGE_SIZE - 1));
-
-    for (int i = 0; i < phdr_count; ++i) {
-        Elf64_Phdr *phdr = &phdr_table[i];
-        if (phdr->p_type != PT_LOAD) continue;
-
-        void *seg_start = (void *)(phdr->p_vaddr & ~(PAGE_SIZE - 1));
-        void *seg_end = (void *)((phdr->p_vaddr + phdr->p_memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
-
-        if (aligned_addr >= seg_start && aligned_addr < seg_end) {
-            size_t offset = aligned_addr - seg_start;
-            size_t file_offset = phdr->p_offset + offset;
-            if (mmap(aligned_addr, PAGE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_FIXED | MAP_PRIVATE, program_fd, file_offset) == MAP_FAILED) {
-                perror("mmap in segfault handler");
-                exit(EXIT_FAILURE);
-            }
+    uintptr_t aligned_addr = PAGE_ALIGN_DOWN((uintptr_t)fault_addr);
+    uint64_t start = stats ? now_ns() : 0;
+
+    // Only pages we haven't mapped yet are ours to resolve; any other fault,
+    // including an access violation on a mapped page, is a real error.
+    page_lock();
+    for (int i = 0; i < image_count; ++i) {
+        int ret = map_page(&images[i], aligned_addr);
+        if (ret == 0) {
+            plan_record_page(&images[i], aligned_addr);
+            stats_fault(start);
+        }
+        // Another thread mapping the page first is no error
+        if (ret == 0 || (ret == 1 && fault_allowed(&images[i], aligned_addr, context))) {
+            page_unlock();
             return;
         }
     }
+    page_unlock();
 
     // Preserving memory access errors
     fprintf(stderr, "Segmentation fault (invalid memory access) at address: %p\n", fault_addr);
@@ -51,6 +50,8 @@ void setup_signal_handler() {
     memset(&sa, 0, sizeof(struct sigaction));
     sa.sa_flags = SA_SIGINFO;
     sa.sa_sigaction = segfault_handler;
+    // No other handler may run, and maybe fault, while this one holds page_lock
+    sigfillset(&sa.sa_mask);
 
     if (sigaction(SIGSEGV, &sa, NULL) == -1) {
         perror("sigaction");
@@ -59,94 +60,43 @@ void setup_signal_handler() {
 }
 
 void load_program(const char *program_name) {
-    program_fd = open(program_name, O_RDONLY);
-    if (program_fd == -1) {
-        perror("open");
-        exit(EXIT_FAILURE);
-    }
+    image_count = load_images(program_name, images);
 
-    Elf64_Ehdr ehdr;
-    if (read(program_fd, &ehdr, sizeof(ehdr)) != sizeof(ehdr)) {
-        perror("read");
-        exit(EXIT_FAILURE);
-    }
-
-    lseek(program_fd, ehdr.e_phoff, SEEK_SET);
-    for (int i = 0; i < ehdr.e_phnum && i < MAX_PHDR_COUNT; ++i) {
-        Elf64_Phdr phdr;
-        if (read(program_fd, &phdr, sizeof(phdr)) != sizeof(phdr)) {
-            perror("read");
-            exit(EXIT_FAILURE);
+    // libc and ld.so mprotect RELRO during startup, which fails on pages not mapped yet
+    for (int i = 0; i < image_count; ++i) {
+        Elf64_Phdr *relro = &images[i].relro;
+        if (relro->p_type == PT_GNU_RELRO) {
+            map_range(&images[i], relro->p_vaddr, relro->p_vaddr + relro->p_memsz);
         }
-
-        if (phdr.p_type == PT_LOAD) {
-            phdr_table[phdr_count++] = phdr;
-        }
-    }
-
-    entry_point = ehdr.e_entry;
-}
-
-void *setup_stack(int argc, char *argv[], char *envp[]) {
-    void *stack = mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
-    if (stack == MAP_FAILED) {
-        perror("mmap stack");
-        exit(EXIT_FAILURE);
     }
 
-    char **new_argv = (char **)(stack + STACK_SIZE - (argc + 1) * sizeof(char *));
-    for (int i = 0; i < argc; i++) {
-        new_argv[i] = strdup(argv[i + 1]);  // Skip the loader's name
-    }
-    new_argv[argc] = NULL;
-
-    // Copy environment variables
-    int envc;
-    for (envc = 0; envp[envc] != NULL; ++envc);
-    char **new_envp = new_argv + argc + 1;
-    for (int i = 0; i < envc; i++) {
-        new_envp[i] = strdup(envp[i]);
-    }
-    new_envp[envc] = NULL;
-
-    // Set up auxiliary vectors
-    Elf64_auxv_t *auxv = (Elf64_auxv_t *)(new_envp + envc + 1);
-    for (; auxv->a_type != AT_NULL; ++auxv) {
-        if (auxv->a_type == AT_PHDR) {
-            auxv->a_un.a_val = (uintptr_t)phdr_table;  // Address of the program header table
+    // With -L, text that fills whole huge pages is mapped now; the rest stays demand paged
+    for (int i = 0; options.huge_text && i < image_count; ++i) {
+        for (int j = 0; j < images[i].segment_count; ++j) {
+            map_segment_huge(&images[i], j);
         }
     }
 
-    return new_argv - 1; // Stack pointer should point to argc
+    // Pages earlier -H runs recorded as hot, if this run came from a load plan
+    plan_prefault(images, image_count);
+
+    image_load_info(images, image_count, program_name, &program_info);
 }
 
 int main(int argc, char *argv[], char *envp[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <ELF-file>\n", argv[0]);
+    int first = parse_options(argc, argv);
+    if (first < 0) {
+        fprintf(stderr, "Usage: %s [-r report] [-p plan-dir [-H]] [-L thp|hugetlb] <ELF-file> [args...]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    setup_signal_handler();
-    load_program(argv[1]);
-
-    // Align the stack to a 16-byte boundary and setup the stack
-    void *stack_top = setup_stack(argc - 1, argv, envp);
+    if (options.report_path) {
+        stats_start("dpager", argv[first], options.report_path);
+    }
 
-    // Zero all registers and jump to the entry point using call/ret semantics
-    asm volatile(
-        "xor %%rax, %%rax\n"
-        "xor %%rbx, %%rbx\n"
-        "xor %%rcx, %%rcx\n"
-        "xor %%rdx, %%rdx\n"
-        "xor %%rsi, %%rsi\n"
-        "xor %%rdi, %%rdi\n"
-        "xor %%rbp, %%rbp\n"
-        "mov %0, %%rsp\n"
-        "call *%1\n"
-        :
-        : "r"(stack_top), "r"(entry_point)
-        : "memory"
-    );
+    setup_signal_handler();
+    load_program(argv[first]);
 
-    return 0;
+    void *stack_top = setup_stack(argc - first, argv + first, envp, &program_info);
+    start_program(stack_top, program_info.start);
 }
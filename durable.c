@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "durable.h"
+
+static const char *method_names[] = { "fsync", "fdatasync", "dsync", "rwf_dsync", "sync_file_range" };
+
+struct writer {
+    pthread_t thread;
+    uint64_t *latencies;        // ns, one per record this writer committed
+    int committed;
+};
+
+static const struct durable_options *opts;
+static int log_fd;
+static _Atomic uint64_t next_offset;
+static _Atomic int records_left;
+static _Atomic uint64_t syncs;
+
+// Group commit state: records are numbered as their writes complete, so
+// every record up to `completed` is in the page cache when a sync starts
+static pthread_mutex_t group_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t group_cond;        // on CLOCK_MONOTONIC
+static uint64_t completed;
+static uint64_t durable;
+static uint64_t oldest_pending;         // when the oldest record not yet durable started
+static int syncing;
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int sync_method_named(const char *name) {
+    for (int m = 0; m < (int)(sizeof(method_names) / sizeof(method_names[0])); m++) {
+        if (strcmp(name, method_names[m]) == 0) return m;
+    }
+    return -1;
+}
+
+static int syncs_itself(void) {
+    return opts->method == SYNC_ODSYNC || opts->method == SYNC_RWF_DSYNC;
+}
+
+// Make everything written to [start, end) durable
+static void sync_log(uint64_t start, uint64_t end) {
+    int ret = 0;
+    if (opts->method == SYNC_FSYNC) {
+        ret = fsync(log_fd);
+    } else if (opts->method == SYNC_FDATASYNC) {
+        ret = fdatasync(log_fd);
+    } else if (opts->method == SYNC_FILE_RANGE) {
+        ret = sync_file_range(log_fd, start, end - start,
+                              SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+    if (ret != 0) {
+        perror(method_names[opts->method]);
+        exit(EXIT_FAILURE);
+    }
+    atomic_fetch_add(&syncs, 1);
+}
+
+static void write_record(const char *buf, uint64_t offset) {
+    ssize_t ret;
+    if (opts->method == SYNC_RWF_DSYNC) {
+        struct iovec iov = { (void *)buf, opts->record_size };
+        ret = pwritev2(log_fd, &iov, 1, offset, RWF_DSYNC);
+    } else {
+        ret = pwrite(log_fd, buf, opts->record_size, offset);
+    }
+    if (ret != opts->record_size) {
+        perror("pwrite");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Until the group reaches `batch` records or the oldest is `interval_us`
+// old. Every writer has at most one record waiting, so the group can't
+// grow past the number of writers. Called with group_lock held.
+static void gather(void) {
+    uint64_t deadline = opts->interval_us ? oldest_pending + (uint64_t)opts->interval_us * 1000 : 0;
+    uint64_t enough = opts->batch < opts->writers ? opts->batch : opts->writers;
+    while ((enough > 1 || deadline) && atomic_load(&records_left) > 0) {
+        if (enough > 1 && completed - durable >= enough) break;
+        if (!deadline) {
+            pthread_cond_wait(&group_cond, &group_lock);
+            continue;
+        }
+        if (now_ns() >= deadline) break;
+        struct timespec until;
+        until.tv_sec = deadline / 1000000000;
+        until.tv_nsec = deadline % 1000000000;
+        pthread_cond_timedwait(&group_cond, &group_lock, &until);
+    }
+}
+
+static void *group_writer(void *arg) {
+    struct writer *w = arg;
+    char *buf = malloc(opts->record_size);
+    if (!buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(buf, 'A', opts->record_size);
+
+    while (atomic_fetch_sub(&records_left, 1) > 0) {
+        uint64_t offset = atomic_fetch_add(&next_offset, opts->record_size);
+        uint64_t start = now_ns();
+        write_record(buf, offset);
+
+        pthread_mutex_lock(&group_lock);
+        uint64_t mine = ++completed;
+        if (!oldest_pending) oldest_pending = start;
+        pthread_cond_broadcast(&group_cond);
+        while (durable < mine) {
+            if (syncing) {
+                pthread_cond_wait(&group_cond, &group_lock);
+                continue;
+            }
+            // Lead: sync for everyone whose write has completed
+            syncing = 1;
+            gather();
+            uint64_t target = completed;
+            oldest_pending = 0;
+            pthread_mutex_unlock(&group_lock);
+            sync_log(0, atomic_load(&next_offset));
+            pthread_mutex_lock(&group_lock);
+            durable = target;
+            syncing = 0;
+            pthread_cond_broadcast(&group_cond);
+        }
+        pthread_mutex_unlock(&group_lock);
+        w->latencies[w->committed++] = now_ns() - start;
+    }
+    free(buf);
+    return NULL;
+}
+
+// One writer on its own: sync every `batch` records or `interval_us`
+static void *solo_writer(void *arg) {
+    struct writer *w = arg;
+    char *buf = malloc(opts->record_size);
+    uint64_t *starts = malloc((opts->batch > 0 ? opts->batch : opts->records) * sizeof(uint64_t));
+    if (!buf || !starts) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(buf, 'A', opts->record_size);
+
+    int pending = 0;
+    uint64_t batch_start = 0;
+    while (atomic_fetch_sub(&records_left, 1) > 0) {
+        uint64_t offset = atomic_fetch_add(&next_offset, opts->record_size);
+        uint64_t start = now_ns();
+        if (!pending) batch_start = offset;
+        write_record(buf, offset);
+        starts[pending++] = start;
+
+        int last = atomic_load(&records_left) <= 0;
+        if (!syncs_itself() && !last && (opts->batch == 0 || pending < opts->batch) &&
+            (opts->interval_us == 0 || now_ns() - starts[0] < (uint64_t)opts->interval_us * 1000)) {
+            continue;
+        }
+        if (!syncs_itself()) sync_log(batch_start, offset + opts->record_size);
+        uint64_t end = now_ns();
+        for (int i = 0; i < pending; i++) w->latencies[w->committed++] = end - starts[i];
+        pending = 0;
+    }
+    free(starts);
+    free(buf);
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const uint64_t *sorted, size_t n, double p) {
+    size_t i = (size_t)(p / 100 * n);
+    return sorted[i < n ? i : n - 1] / 1e3;
+}
+
+void durable_writes(const char *path, const struct durable_options *options) {
+    opts = options;
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | (options->method == SYNC_ODSYNC ? O_DSYNC : 0);
+    log_fd = open(path, flags, 0644);
+    if (log_fd == -1) {
+        perror("open");
+        exit(EXIT_FAILURE);
+    }
+    if (options->writers == 1 && options->batch == 0 && options->interval_us == 0 && !syncs_itself()) {
+        fprintf(stderr, "Nothing would ever sync: give a batch size or an interval.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int group = options->writers > 1 && !syncs_itself();
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&group_cond, &attr);
+    struct writer *writers = calloc(options->writers, sizeof(struct writer));
+    if (!writers) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < options->writers; i++) {
+        writers[i].latencies = malloc(options->records * sizeof(uint64_t));
+        if (!writers[i].latencies) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    records_left = options->records;
+    uint64_t start = now_ns();
+    for (int i = 0; i < options->writers; i++) {
+        if (pthread_create(&writers[i].thread, NULL, group ? group_writer : solo_writer, &writers[i]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < options->writers; i++) pthread_join(writers[i].thread, NULL);
+    double seconds = (now_ns() - start) / 1e9;
+    close(log_fd);
+
+    uint64_t *all = malloc(options->records * sizeof(uint64_t));
+    size_t n = 0;
+    if (!all) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < options->writers; i++) {
+        memcpy(all + n, writers[i].latencies, writers[i].committed * sizeof(uint64_t));
+        n += writers[i].committed;
+        free(writers[i].latencies);
+    }
+    qsort(all, n, sizeof(uint64_t), compare_u64);
+
+    printf("%s, %d writer%s%s, sync every %d records / %d us: %zu records of %d bytes\n",
+           method_names[options->method], options->writers, options->writers > 1 ? "s" : "",
+           group ? " (group commit)" : "", options->batch, options->interval_us, n, options->record_size);
+    printf("%10s %10s %10s %10s %10s %10s\n", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "mean us");
+    double mean = 0;
+    for (size_t i = 0; i < n; i++) mean += all[i];
+    printf("%10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", percentile(all, n, 50), percentile(all, n, 90),
+           percentile(all, n, 99), percentile(all, n, 99.9), all[n - 1] / 1e3, mean / n / 1e3);
+    printf("%.0f commits/s, %.1f MiB/s, %lu syncs (%.1f records each)\n", n / seconds,
+           n * (double)options->record_size / seconds / (1 << 20), atomic_load(&syncs),
+           atomic_load(&syncs) ? (double)n / atomic_load(&syncs) : 0.0);
+    free(all);
+    free(writers);
+}
@@ -0,0 +1,42 @@
+#ifndef DURABLE_H
+#define DURABLE_H
+
+// Commit latency of a write-ahead log: writers append fixed-size records
+// to a file and make them durable with one of the sync methods below,
+// after every `batch` records or once the oldest unsynced record is
+// `interval_us` old, whichever comes first (0 turns a trigger off).
+// A record's commit latency runs from the start of its write to the end
+// of the sync that covers it.
+//
+// With several writers, the syncing methods do group commit: a writer
+// whose record isn't durable yet either waits for the sync in progress or,
+// if there is none, becomes the leader and syncs everything written so
+// far on behalf of everyone. The leader first waits for `batch` records or
+// `interval_us`, if set, to let the group grow.
+
+enum sync_method {
+    SYNC_FSYNC,
+    SYNC_FDATASYNC,
+    SYNC_ODSYNC,        // the file is opened O_DSYNC; every write commits itself
+    SYNC_RWF_DSYNC,     // pwritev2 with RWF_DSYNC, likewise
+    SYNC_FILE_RANGE,    // writes the range back but doesn't flush the disk cache or metadata
+};
+
+struct durable_options {
+    enum sync_method method;
+    int batch;
+    int interval_us;
+    int writers;
+    int records;        // in all
+    int record_size;
+};
+
+// Returns the method called `name` ("fsync", "fdatasync", "dsync",
+// "rwf_dsync" or "sync_file_range"), or -1.
+int sync_method_named(const char *name);
+
+// Opens `path` as the method needs, runs the writers, and prints commit
+// latency percentiles and throughput. Exits on errors.
+void durable_writes(const char *path, const struct durable_options *options);
+
+#endif
@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <elf.h>
+#include "packed.h"
+#include "lz4.h"
+
+// Convert an ELF executable into the packed format the pagers decompress on
+// fault (see packed.h). Clusters that don't shrink are stored raw.
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <ELF-file> <packed-file>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int in_fd = open(argv[1], O_RDONLY);
+    if (in_fd < 0) {
+        perror(argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    if (fstat(in_fd, &st) != 0) {
+        perror("fstat");
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned char *elf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+    if (elf == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    if (st.st_size < sizeof(Elf64_Ehdr) || memcmp(elf, ELFMAG, SELFMAG) != 0) {
+        fprintf(stderr, "%s: not an ELF file.\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    struct packed_header header = {
+        .magic = PACKED_MAGIC,
+        .version = PACKED_VERSION,
+        .cluster_size = PACKED_CLUSTER_SIZE,
+        .cluster_count = (st.st_size + PACKED_CLUSTER_SIZE - 1) / PACKED_CLUSTER_SIZE,
+        .file_size = st.st_size,
+    };
+    size_t table_size = header.cluster_count * sizeof(struct packed_cluster);
+    struct packed_cluster *clusters = calloc(header.cluster_count, sizeof(struct packed_cluster));
+    unsigned char *block = malloc(LZ4_BOUND(PACKED_CLUSTER_SIZE));
+
+    int out_fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 0777);
+    if (out_fd < 0) {
+        perror(argv[2]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Blocks follow the header and cluster table, which are written last
+    off_t offset = sizeof(header) + table_size;
+    for (uint32_t i = 0; i < header.cluster_count; i++) {
+        const unsigned char *src = elf + (size_t)i * PACKED_CLUSTER_SIZE;
+        int len = st.st_size - (size_t)i * PACKED_CLUSTER_SIZE;
+        if (len > PACKED_CLUSTER_SIZE) len = PACKED_CLUSTER_SIZE;
+
+        int size = lz4_compress(src, len, block, LZ4_BOUND(PACKED_CLUSTER_SIZE));
+        if (size < 0 || size >= len) {
+            clusters[i].flags = PACKED_RAW;
+            size = len;
+            src = elf + (size_t)i * PACKED_CLUSTER_SIZE;
+        } else {
+            src = block;
+        }
+
+        clusters[i].offset = offset;
+        clusters[i].size = size;
+        if (pwrite(out_fd, src, size, offset) != size) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        offset += size;
+    }
+
+    if (pwrite(out_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        pwrite(out_fd, clusters, table_size, sizeof(header)) != table_size) {
+        perror("write");
+        exit(EXIT_FAILURE);
+    }
+    close(out_fd);
+
+    printf("%s: %ld -> %ld bytes (%.1f%%), %u clusters of %d KiB\n", argv[2], (long)st.st_size, (long)offset,
+           100.0 * offset / st.st_size, header.cluster_count, PACKED_CLUSTER_SIZE / 1024);
+    return 0;
+}
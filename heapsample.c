@@ -0,0 +1,266 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "heapsample.h"
+
+#define SAMPLE_BUCKETS 65536            // a power of two
+#define SAMPLE_STRIPES 64
+#define SKIP_FRAMES 2                   // sample_record and the allocator entry point
+
+struct sample {
+    struct sample *next;        // hash chain
+    uintptr_t ptr;
+    size_t size;
+    double weight;              // allocations this sample stands for
+    int depth;
+    void *stack[SAMPLE_DEPTH];
+};
+
+// Chains are changed under their stripe's lock. A bit per bucket says
+// whether its chain is empty; free tests it without the lock, so blocks
+// that were never sampled cost one load from an 8 KiB bitmap that stays
+// in cache (the bucket heads themselves would not).
+static struct sample *buckets[SAMPLE_BUCKETS];
+static _Atomic uint64_t occupied[SAMPLE_BUCKETS / 64];
+static pthread_mutex_t stripes[SAMPLE_STRIPES];
+static double sample_mean;
+
+static __thread int64_t until_sample __attribute__((tls_model("initial-exec")));
+static __thread uint64_t rng_state __attribute__((tls_model("initial-exec")));
+
+static size_t bucket_of(uintptr_t ptr) {
+    return (ptr >> 4) * 0x9e3779b97f4a7c15ULL >> (64 - 16);
+}
+
+static pthread_mutex_t *stripe_of(size_t bucket) {
+    return &stripes[bucket % SAMPLE_STRIPES];
+}
+
+// Bytes to the next sample, exponentially distributed with mean sample_mean
+static int64_t next_interval(void) {
+    if (!rng_state) rng_state = ((uint64_t)gettid() << 32 | (uint64_t)(uintptr_t)&rng_state) | 1;
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    double u = (rng_state >> 11) * (1.0 / 9007199254740992.0);
+    return (int64_t)(-log(1.0 - u) * sample_mean) + 1;
+}
+
+void sample_init(double mean) {
+    sample_mean = mean;
+    for (int i = 0; i < SAMPLE_STRIPES; i++) pthread_mutex_init(&stripes[i], NULL);
+
+    // The first backtrace loads the unwinder, which allocates
+    void *frames[4];
+    backtrace(frames, 4);
+}
+
+int sample_due(size_t size) {
+    until_sample -= size;
+    if (until_sample > 0) return 0;
+
+    // A thread's first allocation only starts its countdown
+    int due = rng_state != 0;
+    until_sample = next_interval();
+    return due;
+}
+
+void sample_record(void *p, size_t size) {
+    struct sample *s = malloc(sizeof(*s));
+    if (!s || !p) {
+        free(s);
+        return;
+    }
+
+    void *frames[SAMPLE_DEPTH + SKIP_FRAMES];
+    int depth = backtrace(frames, SAMPLE_DEPTH + SKIP_FRAMES) - SKIP_FRAMES;
+    s->depth = depth > 0 ? depth : 0;
+    memcpy(s->stack, frames + SKIP_FRAMES, s->depth * sizeof(void *));
+    s->ptr = (uintptr_t)p;
+    s->size = size;
+    // A block of `size` bytes is picked with probability 1 - e^(-size/mean)
+    s->weight = 1.0 / -expm1(-(double)(size ? size : 1) / sample_mean);
+
+    sample_restore(s);
+}
+
+struct sample *sample_take(void *p) {
+    size_t bucket = bucket_of((uintptr_t)p);
+    uint64_t bit = 1ULL << (bucket % 64);
+    if (!(atomic_load_explicit(&occupied[bucket / 64], memory_order_relaxed) & bit)) return NULL;
+
+    pthread_mutex_lock(stripe_of(bucket));
+    struct sample *s = buckets[bucket], *prev = NULL;
+    while (s && s->ptr != (uintptr_t)p) {
+        prev = s;
+        s = s->next;
+    }
+    if (s && prev) {
+        prev->next = s->next;
+    } else if (s) {
+        buckets[bucket] = s->next;
+    }
+    if (!buckets[bucket]) atomic_fetch_and_explicit(&occupied[bucket / 64], ~bit, memory_order_relaxed);
+    pthread_mutex_unlock(stripe_of(bucket));
+    return s;
+}
+
+void sample_restore(struct sample *s) {
+    size_t bucket = bucket_of(s->ptr);
+    pthread_mutex_lock(stripe_of(bucket));
+    s->next = buckets[bucket];
+    buckets[bucket] = s;
+    atomic_fetch_or_explicit(&occupied[bucket / 64], 1ULL << (bucket % 64), memory_order_relaxed);
+    pthread_mutex_unlock(stripe_of(bucket));
+}
+
+void sample_forget(void *p) {
+    free(sample_take(p));
+}
+
+// One line of a profile: everything sampled at the same call stack
+struct site {
+    int depth;
+    void *stack[SAMPLE_DEPTH];
+    double objects;
+    double bytes;
+};
+
+static int compare_stack(const void *a, const void *b) {
+    const struct site *x = a, *y = b;
+    if (x->depth != y->depth) return x->depth - y->depth;
+    return memcmp(x->stack, y->stack, x->depth * sizeof(void *));
+}
+
+static int compare_bytes(const void *a, const void *b) {
+    const struct site *x = a, *y = b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+// Append a stripe's samples to sites[*n...]. Returns 0 when they don't all
+// fit in `capacity`.
+static int copy_stripe(int stripe, struct site *sites, size_t *n, size_t capacity) {
+    for (size_t b = stripe; b < SAMPLE_BUCKETS; b += SAMPLE_STRIPES) {
+        for (struct sample *s = buckets[b]; s; s = s->next) {
+            if (*n == capacity) return 0;
+            sites[*n].depth = s->depth;
+            memcpy(sites[*n].stack, s->stack, s->depth * sizeof(void *));
+            sites[*n].objects = s->weight;
+            sites[*n].bytes = s->weight * s->size;
+            (*n)++;
+        }
+    }
+    return 1;
+}
+
+// Copy the live samples out, one stripe at a time, and merge equal stacks.
+// A stripe that doesn't fit is copied again after growing `sites`: growing
+// under the lock would re-enter the allocator, and so the profiler.
+static struct site *collect(size_t *count) {
+    size_t capacity = 1024, n = 0;
+    struct site *sites = malloc(capacity * sizeof(*sites));
+    for (int stripe = 0; sites && stripe < SAMPLE_STRIPES; stripe++) {
+        size_t start = n;
+        for (;;) {
+            pthread_mutex_lock(&stripes[stripe]);
+            int fits = copy_stripe(stripe, sites, &n, capacity);
+            pthread_mutex_unlock(&stripes[stripe]);
+            if (fits) break;
+
+            struct site *grown = realloc(sites, 2 * capacity * sizeof(*sites));
+            if (!grown) {
+                free(sites);
+                return NULL;
+            }
+            sites = grown;
+            capacity *= 2;
+            n = start;
+        }
+    }
+    if (!sites) return NULL;
+
+    qsort(sites, n, sizeof(*sites), compare_stack);
+    size_t merged = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (merged > 0 && compare_stack(&sites[merged - 1], &sites[i]) == 0) {
+            sites[merged - 1].objects += sites[i].objects;
+            sites[merged - 1].bytes += sites[i].bytes;
+        } else {
+            sites[merged++] = sites[i];
+        }
+    }
+    *count = merged;
+    return sites;
+}
+
+// "function" when the symbol is known, else "object+0xoffset"
+static void frame_name(void *pc, char *name, size_t len, int offsets) {
+    Dl_info info;
+    if (!dladdr(pc, &info)) {
+        snprintf(name, len, "%p", pc);
+    } else if (info.dli_sname) {
+        if (offsets) {
+            snprintf(name, len, "%s+0x%lx", info.dli_sname, (uintptr_t)pc - (uintptr_t)info.dli_saddr);
+        } else {
+            snprintf(name, len, "%s", info.dli_sname);
+        }
+    } else if (info.dli_fname) {
+        const char *base = strrchr(info.dli_fname, '/');
+        snprintf(name, len, "%s+0x%lx", base ? base + 1 : info.dli_fname,
+                 (uintptr_t)pc - (uintptr_t)info.dli_fbase);
+    } else {
+        snprintf(name, len, "%p", pc);
+    }
+}
+
+int sample_dump(const char *path, int leaks) {
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+
+    size_t count = 0;
+    struct site *sites = collect(&count);
+    if (!sites) {
+        fclose(out);
+        return -1;
+    }
+
+    char name[512];
+    if (leaks) {
+        double objects = 0, bytes = 0;
+        for (size_t i = 0; i < count; i++) {
+            objects += sites[i].objects;
+            bytes += sites[i].bytes;
+        }
+        qsort(sites, count, sizeof(*sites), compare_bytes);
+        fprintf(out, "# still allocated at exit, estimated from samples every %.0f bytes\n", sample_mean);
+        fprintf(out, "# %.0f bytes in %.0f blocks from %zu call stacks\n", bytes, objects, count);
+        for (size_t i = 0; i < count; i++) {
+            fprintf(out, "\n%.0f bytes in %.0f blocks (%.1f%%)\n", sites[i].bytes, sites[i].objects,
+                    bytes > 0 ? 100 * sites[i].bytes / bytes : 0);
+            for (int f = 0; f < sites[i].depth; f++) {
+                frame_name(sites[i].stack[f], name, sizeof(name), 1);
+                fprintf(out, "    #%d %s\n", f, name);
+            }
+        }
+    } else {
+        // Folded stacks run from the outermost frame in
+        for (size_t i = 0; i < count; i++) {
+            for (int f = sites[i].depth - 1; f >= 0; f--) {
+                frame_name(sites[i].stack[f], name, sizeof(name), 0);
+                fprintf(out, "%s%s", name, f > 0 ? ";" : "");
+            }
+            fprintf(out, " %.0f\n", sites[i].bytes);
+        }
+    }
+
+    free(sites);
+    return fclose(out);
+}
@@ -0,0 +1,44 @@
+#ifndef HEAPSAMPLE_H
+#define HEAPSAMPLE_H
+
+#include <stddef.h>
+
+// Sampling heap profiler for sharedlib.so. Instead of recording every
+// call, about one allocation per `mean` bytes is sampled: the gaps between
+// samples are drawn from an exponential distribution, as tcmalloc does,
+// so every byte is equally likely to be picked and big blocks almost
+// always are. A sample keeps the block's size, its weight (how many
+// allocations it stands for) and its call stack, in a hash table of live
+// samples that free removes it from. Dumps estimate the heap in use per
+// call stack.
+
+#define SAMPLE_DEPTH 32
+
+void sample_init(double mean);
+
+// Count an allocation of `size` bytes against this thread's sampling
+// interval. Returns nonzero when it should be recorded.
+int sample_due(size_t size);
+
+// Record the block `p`, whose allocation sample_due picked. The caller
+// keeps the allocator from re-entering the profiler meanwhile.
+void sample_record(void *p, size_t size);
+
+// The block `p` is being freed. Cheap unless `p` was sampled.
+void sample_forget(void *p);
+
+// Take the sample for `p` out of the table, or return NULL if there is
+// none. realloc does this before the old block can be freed and its
+// address reused, then frees the sample, or puts it back with
+// sample_restore if the block survived.
+struct sample;
+struct sample *sample_take(void *p);
+void sample_restore(struct sample *s);
+
+// Write the live samples to `path`: with `leaks`, as a report of the
+// biggest call stacks with symbolized frames; otherwise as folded stacks
+// ("outer;...;inner bytes" lines) that flamegraph.pl reads. Returns 0, or
+// -1 with errno set.
+int sample_dump(const char *path, int leaks);
+
+#endif
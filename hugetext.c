@@ -0,0 +1,93 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "loader.h"
+#include "stats.h"
+#include "hugetext.h"
+
+#define HUGE_ALIGN_DOWN(x) ((x) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1))
+#define HUGE_ALIGN_UP(x) (((x) + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1))
+
+int huge_text_mode(const char *name) {
+    if (strcmp(name, "thp") == 0) return HUGE_TEXT_THP;
+    if (strcmp(name, "hugetlb") == 0) return HUGE_TEXT_HUGETLB;
+    return HUGE_TEXT_OFF;
+}
+
+// How much of the mapping at `start` the kernel really put on huge pages,
+// from /proc/self/smaps. THP can quietly fall back to small pages.
+static uint64_t huge_backed(uintptr_t start) {
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps) return 0;
+
+    char line[256];
+    int found = 0;
+    uint64_t kb, bytes = 0;
+    while (fgets(line, sizeof(line), smaps)) {
+        uintptr_t lo, hi;
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+            if (found) break;
+            found = lo == start;
+        } else if (found && (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+                             sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1)) {
+            bytes += kb * 1024;
+        }
+    }
+    fclose(smaps);
+    return bytes;
+}
+
+static int map_huge(uintptr_t lo, size_t length) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+
+    if (options.huge_text == HUGE_TEXT_HUGETLB) {
+        if (mmap((void *)lo, length, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0) != MAP_FAILED) return 0;
+        // No pages reserved, most likely; transparent ones are the next best thing
+        perror("mmap MAP_HUGETLB");
+    }
+    if (mmap((void *)lo, length, PROT_READ | PROT_WRITE, flags, -1, 0) == MAP_FAILED) return -1;
+    if (madvise((void *)lo, length, MADV_HUGEPAGE) != 0) perror("madvise MADV_HUGEPAGE");
+    return 0;
+}
+
+int map_segment_huge(struct elf_image *image, int index) {
+    const Elf64_Phdr *phdr = &image->segments[index];
+    if (!(phdr->p_flags & PF_X) || (phdr->p_flags & PF_W)) return 0;
+
+    uintptr_t lo = HUGE_ALIGN_UP(phdr->p_vaddr);
+    uintptr_t hi = HUGE_ALIGN_DOWN(phdr->p_vaddr + phdr->p_memsz);
+    if (hi <= lo) return 0;
+
+    // The edges, and the file mapping the middle is about to replace
+    map_segment(image, index);
+
+    if (map_huge(lo, hi - lo) != 0) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    uintptr_t file_end = phdr->p_vaddr + phdr->p_filesz;
+    uintptr_t copy_end = file_end < hi ? file_end : hi;
+    if (copy_end > lo) {
+        size_t want = copy_end - lo;
+        if (image_pread(image, (void *)lo, want, phdr->p_offset + (lo - phdr->p_vaddr)) != want) {
+            perror("pread");
+            exit(EXIT_FAILURE);
+        }
+        if (stats) {
+            stats->file_bytes_read += want;
+            if (!image->packed) stats->file_bytes_mapped -= PAGE_ALIGN_DOWN(copy_end) - lo;
+        }
+    }
+    if (mprotect((void *)lo, hi - lo, segment_prot(phdr)) != 0) {
+        perror("mprotect");
+        exit(EXIT_FAILURE);
+    }
+
+    if (stats) {
+        stats->huge_text_bytes += hi - lo;
+        stats->huge_text_backed += huge_backed(lo);
+    }
+    return 1;
+}
@@ -0,0 +1,30 @@
+#ifndef HUGETEXT_H
+#define HUGETEXT_H
+
+#include "loader.h"
+
+// -L: put text on 2 MiB pages to cut iTLB misses in programs with large
+// hot code. Every 2 MiB-aligned range that lies wholly inside a read-only
+// executable segment is copied into anonymous memory backed by huge pages,
+// either transparent ones (MADV_HUGEPAGE) or hugetlbfs pages
+// (MAP_HUGETLB, which needs vm.nr_hugepages reserved). The head and tail
+// of the segment, and any segment too small to hold an aligned 2 MiB
+// range, keep their 4 KiB mappings.
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+enum huge_text_mode {
+    HUGE_TEXT_OFF,
+    HUGE_TEXT_THP,
+    HUGE_TEXT_HUGETLB,
+};
+
+// Parse the -L argument: "thp" or "hugetlb". Returns HUGE_TEXT_OFF otherwise.
+int huge_text_mode(const char *name);
+
+// Map image->segments[index] with its aligned middle on huge pages and the
+// rest as map_segment would. Returns 0, without mapping anything, when the
+// segment isn't executable, is writable, or holds no aligned 2 MiB range.
+int map_segment_huge(struct elf_image *image, int index);
+
+#endif
@@ -7,10 +7,13 @@
 #include <sys/stat.h>
 #include <liburing.h>
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <sys/ioctl.h>
 
 #define QD  4
 #define BS (128 * 1024)
+#define DELTA_MIN (4 * BS)     // smaller changed files are just rewritten
 
 // Recursive copying implementating using io_uring 
 // CS380L - Final Project
@@ -18,6 +21,42 @@
 
 static int infd, outfd;
 
+// Files with more than one link, by (device, inode): where the first one
+// was copied to, so the others can be linked to it
+struct inode_entry {
+    dev_t dev;
+    ino_t ino;
+    char *dst;              // NULL for an empty slot
+};
+
+static struct inode_entry *inode_map;
+static size_t inode_map_size, inode_map_used;     // size is a power of two
+
+static unsigned long files_copied, links_made, symlinks_made, files_skipped;
+static unsigned long long bytes_copied, bytes_saved, bytes_unchanged;
+static int incremental;
+
+// A block of a changed file, read from both sides and written back only
+// if they differ. Each request's user data is one of its block_io.
+enum { BLOCK_SRC, BLOCK_DST, BLOCK_WRITE };
+
+struct block_pair;
+
+struct block_io {
+    struct block_pair *pair;
+    int kind;
+};
+
+struct block_pair {
+    struct block_io io[3];
+    int waiting;                    // reads still in flight
+    off_t offset;
+    size_t len;
+    size_t src_len, dst_len;        // bytes read so far
+    struct iovec iov;               // for the write
+    char *src, *dst;
+};
+
 struct io_data {
     int read;
     off_t first_offset, offset;
@@ -195,13 +234,251 @@ static int copy_file_io_uring(int infd, int outfd, struct io_uring *ring, off_t
         }
     }
 
+    // The last writes are still in flight; their completions mustn't be
+    // taken for the next file's
+    while (writes) {
+        struct io_data *data;
+
+        ret = io_uring_wait_cqe(ring, &cqe);
+        if (ret < 0) {
+            fprintf(stderr, "io_uring_wait_cqe: %s\n", strerror(-ret));
+            return 1;
+        }
+        data = io_uring_cqe_get_data(cqe);
+        if (cqe->res < 0 && cqe->res != -EAGAIN) {
+            fprintf(stderr, "cqe failed: %s\n", strerror(-cqe->res));
+            return 1;
+        }
+        if (cqe->res >= 0 && cqe->res == data->iov.iov_len) {
+            free(data);
+            writes--;
+        } else {
+            if (cqe->res > 0) {
+                data->iov.iov_base += cqe->res;
+                data->iov.iov_len -= cqe->res;
+            }
+            queue_prepped(ring, data, outfd);
+            io_uring_submit(ring);
+        }
+        io_uring_cqe_seen(ring, cqe);
+    }
+
+    return 0;
+}
+
+static struct inode_entry *inode_slot(dev_t dev, ino_t ino) {
+    size_t i = ((unsigned long long)ino * 0x9e3779b97f4a7c15ULL ^ dev) & (inode_map_size - 1);
+
+    while (inode_map[i].dst && (inode_map[i].dev != dev || inode_map[i].ino != ino))
+        i = (i + 1) & (inode_map_size - 1);
+    return &inode_map[i];
+}
+
+static const char *inode_lookup(dev_t dev, ino_t ino) {
+    if (!inode_map)
+        return NULL;
+    return inode_slot(dev, ino)->dst;
+}
+
+static void inode_remember(dev_t dev, ino_t ino, const char *dst) {
+    struct inode_entry *entry;
+
+    if (2 * (inode_map_used + 1) > inode_map_size) {
+        struct inode_entry *old = inode_map;
+        size_t old_size = inode_map_size;
+
+        inode_map_size = old_size ? 2 * old_size : 1024;
+        inode_map = calloc(inode_map_size, sizeof(*inode_map));
+        if (!inode_map) {
+            perror("calloc");
+            exit(1);
+        }
+        for (size_t i = 0; i < old_size; i++) {
+            if (old[i].dst)
+                *inode_slot(old[i].dev, old[i].ino) = old[i];
+        }
+        free(old);
+    }
+
+    entry = inode_slot(dev, ino);
+    if (entry->dst)
+        return;
+    entry->dev = dev;
+    entry->ino = ino;
+    entry->dst = strdup(dst);
+    if (!entry->dst) {
+        perror("strdup");
+        exit(1);
+    }
+    inode_map_used++;
+}
+
+// Replace whatever is at `dst` with a hard link to `target`
+static int link_replacing(const char *target, const char *dst) {
+    if (link(target, dst) == 0)
+        return 0;
+    if (errno != EEXIST || unlink(dst) != 0)
+        return -1;
+    return link(target, dst);
+}
+
+static int copy_symlink(const char *src, const char *dst) {
+    char target[PATH_MAX];
+    ssize_t len;
+
+    len = readlink(src, target, sizeof(target) - 1);
+    if (len < 0) {
+        perror("readlink");
+        return -1;
+    }
+    target[len] = '\0';
+
+    if (symlink(target, dst) != 0 && (errno != EEXIST || unlink(dst) != 0 || symlink(target, dst) != 0)) {
+        perror("symlink");
+        return -1;
+    }
+    symlinks_made++;
+    return 0;
+}
+
+static void queue_pair_read(struct io_uring *ring, struct block_pair *pair, int dst, int fd) {
+    struct io_uring_sqe *sqe;
+    size_t done = dst ? pair->dst_len : pair->src_len;
+
+    sqe = io_uring_get_sqe(ring);
+    assert(sqe);
+    io_uring_prep_read(sqe, fd, (dst ? pair->dst : pair->src) + done, pair->len - done, pair->offset + done);
+    io_uring_sqe_set_data(sqe, &pair->io[dst ? BLOCK_DST : BLOCK_SRC]);
+}
+
+static void queue_pair_write(struct io_uring *ring, struct block_pair *pair, int fd) {
+    struct io_uring_sqe *sqe;
+
+    sqe = io_uring_get_sqe(ring);
+    assert(sqe);
+    io_uring_prep_writev(sqe, fd, &pair->iov, 1, pair->offset + (pair->len - pair->iov.iov_len));
+    io_uring_sqe_set_data(sqe, &pair->io[BLOCK_WRITE]);
+}
+
+// Bring the existing copy `outfd` (opened read-write) up to date with
+// `infd`: both sides are read through the ring, up to QD blocks at a
+// time, and only blocks that differ are written.
+static int sync_file_io_uring(int infd, int outfd, struct io_uring *ring, off_t insize) {
+    struct io_uring_cqe *cqe;
+    struct stat st;
+    off_t offset = 0;
+    int in_flight = 0, ret;
+
+    if (fstat(outfd, &st) < 0 || (st.st_size > insize && ftruncate(outfd, insize) < 0)) {
+        perror("truncate dst");
+        return 1;
+    }
+
+    while (offset < insize || in_flight) {
+        int queued = 0;
+
+        while (offset < insize && in_flight < QD) {
+            struct block_pair *pair = malloc(sizeof(*pair) + 2 * BS);
+
+            if (!pair)
+                return 1;
+            memset(pair, 0, sizeof(*pair));
+            for (int kind = BLOCK_SRC; kind <= BLOCK_WRITE; kind++) {
+                pair->io[kind].pair = pair;
+                pair->io[kind].kind = kind;
+            }
+            pair->offset = offset;
+            pair->len = insize - offset < BS ? insize - offset : BS;
+            pair->src = (char *)(pair + 1);
+            pair->dst = pair->src + BS;
+            pair->waiting = 2;
+            queue_pair_read(ring, pair, 0, infd);
+            queue_pair_read(ring, pair, 1, outfd);
+            offset += pair->len;
+            in_flight++;
+            queued = 1;
+        }
+        if (queued) {
+            ret = io_uring_submit(ring);
+            if (ret < 0) {
+                fprintf(stderr, "io_uring_submit: %s\n", strerror(-ret));
+                return 1;
+            }
+        }
+
+        ret = io_uring_wait_cqe(ring, &cqe);
+        if (ret < 0) {
+            fprintf(stderr, "io_uring_wait_cqe: %s\n", strerror(-ret));
+            return 1;
+        }
+        do {
+            struct block_io *io = io_uring_cqe_get_data(cqe);
+            struct block_pair *pair = io->pair;
+            int res = cqe->res;
+
+            io_uring_cqe_seen(ring, cqe);
+            if (res < 0) {
+                fprintf(stderr, "cqe failed: %s\n", strerror(-res));
+                return 1;
+            }
+
+            if (io->kind == BLOCK_SRC) {
+                // Short only if the file shrank under us
+                pair->src_len += res;
+                if (pair->src_len < pair->len) {
+                    if (res == 0) {
+                        fprintf(stderr, "source shrank while being copied\n");
+                        return 1;
+                    }
+                    queue_pair_read(ring, pair, 0, infd);
+                    io_uring_submit(ring);
+                    continue;
+                }
+            } else if (io->kind == BLOCK_DST) {
+                // Short at the destination's end of file
+                pair->dst_len += res;
+                if (res > 0 && pair->dst_len < pair->len) {
+                    queue_pair_read(ring, pair, 1, outfd);
+                    io_uring_submit(ring);
+                    continue;
+                }
+            } else {
+                pair->iov.iov_base = (char *)pair->iov.iov_base + res;
+                pair->iov.iov_len -= res;
+                if (pair->iov.iov_len) {
+                    queue_pair_write(ring, pair, outfd);
+                    io_uring_submit(ring);
+                } else {
+                    bytes_copied += pair->len;
+                    free(pair);
+                    in_flight--;
+                }
+                continue;
+            }
+
+            if (--pair->waiting)
+                continue;
+            if (pair->dst_len == pair->len && memcmp(pair->src, pair->dst, pair->len) == 0) {
+                bytes_unchanged += pair->len;
+                free(pair);
+                in_flight--;
+                continue;
+            }
+            pair->iov.iov_base = pair->src;
+            pair->iov.iov_len = pair->len;
+            queue_pair_write(ring, pair, outfd);
+            io_uring_submit(ring);
+        } while (io_uring_peek_cqe(ring, &cqe) == 0);
+    }
+
     return 0;
 }
 
 int copy_recursive(const char *src, const char *dst, struct io_uring *ring) {
-    int src_fd, dst_fd;
+    int src_fd, dst_fd, delta = 0;
     off_t insize;
-    struct stat statbuf;
+    struct stat statbuf, dst_st;
+    struct timespec times[2];
 
     if (lstat(src, &statbuf) != 0) {
         perror("lstat");
@@ -231,14 +508,60 @@ int copy_recursive(const char *src, const char *dst, struct io_uring *ring) {
             }
         }
         closedir(dir);
+    } else if (S_ISLNK(statbuf.st_mode)) {
+        return copy_symlink(src, dst);
     } else if (S_ISREG(statbuf.st_mode)) {
+        // Later links to a file already copied become links to the copy
+        if (statbuf.st_nlink > 1) {
+            const char *first = inode_lookup(statbuf.st_dev, statbuf.st_ino);
+            struct stat first_st;
+
+            if (first && incremental && lstat(dst, &dst_st) == 0 && lstat(first, &first_st) == 0 &&
+                dst_st.st_dev == first_st.st_dev && dst_st.st_ino == first_st.st_ino) {
+                files_skipped++;
+                return 0;
+            }
+            if (first && link_replacing(first, dst) == 0) {
+                links_made++;
+                bytes_saved += statbuf.st_size;
+                return 0;
+            }
+            if (first)
+                perror("link");
+        }
+
+        // A copy with the same size, mtime and link count is taken to be up
+        // to date, and later names of the file are linked to it; an older
+        // copy of a big file is patched in place. A copy whose link count
+        // differs from the source's, or one hard linked to other names, is
+        // unlinked and copied afresh: whether those names still belong
+        // together is unknown
+        if (incremental && lstat(dst, &dst_st) == 0 && S_ISREG(dst_st.st_mode) &&
+            (dst_st.st_nlink == statbuf.st_nlink || dst_st.st_nlink == 1)) {
+            if (dst_st.st_nlink == statbuf.st_nlink && dst_st.st_size == statbuf.st_size &&
+                dst_st.st_mtim.tv_sec == statbuf.st_mtim.tv_sec &&
+                dst_st.st_mtim.tv_nsec == statbuf.st_mtim.tv_nsec) {
+                files_skipped++;
+                if (statbuf.st_nlink > 1)
+                    inode_remember(statbuf.st_dev, statbuf.st_ino, dst);
+                return 0;
+            }
+            delta = dst_st.st_nlink == 1 && statbuf.st_size >= DELTA_MIN;
+        }
+
         src_fd = open(src, O_RDONLY);
         if (src_fd < 0) {
             perror("open src");
             return -1;
         }
 
-        dst_fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, statbuf.st_mode);
+        // An earlier run may have left dst hard linked to other names whose
+        // sources have since been split up; truncating it would rewrite them
+        // all, so give dst an inode of its own
+        if (!delta && lstat(dst, &dst_st) == 0 && dst_st.st_nlink > 1 && unlink(dst) != 0)
+            perror("unlink");
+
+        dst_fd = open(dst, delta ? O_RDWR : O_WRONLY | O_CREAT | O_TRUNC, statbuf.st_mode);
         if (dst_fd < 0) {
             perror("open dst");
             close(src_fd);
@@ -251,14 +574,26 @@ int copy_recursive(const char *src, const char *dst, struct io_uring *ring) {
             return -1;
         }
 
-        if (copy_file_io_uring(src_fd, dst_fd, ring, insize) != 0) {
+        if ((delta ? sync_file_io_uring(src_fd, dst_fd, ring, insize)
+                   : copy_file_io_uring(src_fd, dst_fd, ring, insize)) != 0) {
             close(src_fd);
             close(dst_fd);
             return -1;
         }
 
+        // Matching mtimes are what let the next incremental run skip it
+        times[0] = statbuf.st_atim;
+        times[1] = statbuf.st_mtim;
+        if (futimens(dst_fd, times) != 0)
+            perror("futimens");
         close(src_fd);
         close(dst_fd);
+
+        files_copied++;
+        if (!delta)
+            bytes_copied += insize;
+        if (statbuf.st_nlink > 1)
+            inode_remember(statbuf.st_dev, statbuf.st_ino, dst);
     }
 
     return 0;
@@ -268,19 +603,34 @@ int main(int argc, char *argv[]) {
     struct io_uring ring;
     int ret;
 
+    if (argc > 1 && strcmp(argv[1], "-i") == 0) {
+        incremental = 1;
+        argv++;
+        argc--;
+    }
     if (argc < 3) {
-        printf("Usage: %s <source> <destination>\n", argv[0]);
+        printf("Usage: %s [-i] <source> <destination>\n", argv[0]);
+        printf("  -i  incremental: skip files whose size and mtime match, patch changed blocks\n");
         return 1;
     }
 
-    ret = setup_context(QD, &ring);
+    // Incremental copies keep two reads per block in flight
+    ret = setup_context(2 * QD, &ring);
     if (ret) {
         fprintf(stderr, "setup_context failed\n");
         return 1;
     }
 
     ret = copy_recursive(argv[1], argv[2], &ring);
-
+    printf("%lu files copied (%llu bytes), %lu hard links (%llu bytes saved), %lu symlinks\n",
+           files_copied, bytes_copied, links_made, bytes_saved, symlinks_made);
+    if (incremental)
+        printf("%lu unchanged files skipped, %llu bytes of changed files already up to date\n",
+               files_skipped, bytes_unchanged);
+
+    for (size_t i = 0; i < inode_map_size; i++)
+        free(inode_map[i].dst);
+    free(inode_map);
     io_uring_queue_exit(&ring);
     return ret;
 }
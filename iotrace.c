@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "iotrace.h"
+
+// I/O tracer, loaded with LD_PRELOAD=./iotrace.so. open, read, pread,
+// write, pwrite, lseek and fsync each append a record (descriptor, file
+// offset, length, time, thread) to a ring buffer owned by the calling
+// thread, which a drain thread copies to $IOTRACE_FILE.<pid> (iotrace.<pid>
+// by default), the same way sharedlib.so traces allocations. The pid keeps
+// exec'd children, which inherit LD_PRELOAD, out of their parent's file.
+// "dofileio <file> 5 <trace>" replays the result.
+//
+// Calls made inside libc (stdio's writes, say) don't go through these
+// symbols and aren't seen.
+
+#define RING_RECORDS 16384              // per thread; a power of two
+#define DRAIN_INTERVAL_NS (10 * 1000 * 1000)
+
+// Single producer, single consumer under drain_lock, as in sharedlib.c
+struct ring {
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    _Atomic uint64_t dropped;
+    _Atomic int owned;
+    uint32_t tid;
+    struct ring *next;
+    struct iotrace_record records[RING_RECORDS];
+};
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_openat)(int, const char *, int, ...);
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real_pread)(int, void *, size_t, off_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static ssize_t (*real_pwrite)(int, const void *, size_t, off_t);
+static off_t (*real_lseek)(int, off_t, int);
+static int (*real_fsync)(int);
+static int (*real_fdatasync)(int);
+
+static _Atomic(struct ring *) rings;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static int trace_fd = -1;
+static _Atomic int tracing;
+
+static __thread struct ring *my_ring __attribute__((tls_model("initial-exec")));
+static __thread int exiting __attribute__((tls_model("initial-exec")));  // ring handed back
+
+static void resolve(void) {
+    real_open = dlsym(RTLD_NEXT, "open");
+    real_openat = dlsym(RTLD_NEXT, "openat");
+    real_read = dlsym(RTLD_NEXT, "read");
+    real_pread = dlsym(RTLD_NEXT, "pread");
+    real_write = dlsym(RTLD_NEXT, "write");
+    real_pwrite = dlsym(RTLD_NEXT, "pwrite");
+    real_lseek = dlsym(RTLD_NEXT, "lseek");
+    real_fsync = dlsym(RTLD_NEXT, "fsync");
+    real_fdatasync = dlsym(RTLD_NEXT, "fdatasync");
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Runs as the thread exits. I/O after this would land in a ring that a
+// new thread may already own, so it is dropped.
+static void release_ring(void *arg) {
+    struct ring *r = arg;
+    my_ring = NULL;
+    exiting = 1;
+    atomic_store(&r->owned, 0);
+}
+
+static struct ring *get_ring(void) {
+    if (my_ring) return my_ring;
+
+    struct ring *r;
+    for (r = atomic_load(&rings); r; r = r->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&r->owned, &expected, 1)) break;
+    }
+    if (!r) {
+        r = mmap(NULL, sizeof(*r), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (r == MAP_FAILED) return NULL;
+        r->owned = 1;
+        r->next = atomic_load(&rings);
+        while (!atomic_compare_exchange_weak(&rings, &r->next, r)) {
+        }
+    }
+    r->tid = gettid();
+    pthread_setspecific(ring_key, r);
+    my_ring = r;
+    return r;
+}
+
+// Called with drain_lock held
+static void drain_ring(struct ring *r) {
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    while (tail != head) {
+        uint64_t index = tail & (RING_RECORDS - 1);
+        uint64_t n = head - tail < RING_RECORDS - index ? head - tail : RING_RECORDS - index;
+        if (real_write(trace_fd, &r->records[index], n * sizeof(struct iotrace_record)) < 0) {
+            // Skip what can't be written rather than stall the program
+        }
+        tail += n;
+    }
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+}
+
+static void drain(void) {
+    for (struct ring *r = atomic_load(&rings); r; r = r->next) {
+        drain_ring(r);
+    }
+}
+
+static void append(uint16_t op, int fd, int64_t offset, int64_t length, uint64_t start) {
+    if (!atomic_load_explicit(&tracing, memory_order_relaxed) || fd == trace_fd || exiting) return;
+    struct ring *r = get_ring();
+    if (!r) return;
+
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&r->tail, memory_order_acquire) == RING_RECORDS) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    uint64_t latency = (now_ns() - start) / 1000;
+    struct iotrace_record *rec = &r->records[head & (RING_RECORDS - 1)];
+    rec->ns = start;
+    rec->offset = offset;
+    rec->length = length;
+    rec->fd = fd;
+    rec->tid = r->tid;
+    rec->op = op;
+    rec->latency_us = latency > UINT16_MAX ? UINT16_MAX : latency;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    if (head + 1 - atomic_load_explicit(&r->tail, memory_order_relaxed) >= RING_RECORDS / 2 &&
+        pthread_mutex_trylock(&drain_lock) == 0) {
+        if (atomic_load(&tracing)) drain_ring(r);
+        pthread_mutex_unlock(&drain_lock);
+    }
+}
+
+// Record a call. The caller sees the errno the real call left, not
+// whatever draining did to it.
+static void trace(uint16_t op, int fd, int64_t offset, int64_t length, uint64_t start) {
+    int saved = errno;
+    append(op, fd, offset, length, start);
+    errno = saved;
+}
+
+// Where read and write will start, or -1 if `fd` doesn't seek
+static int64_t position(int fd) {
+    if (!atomic_load_explicit(&tracing, memory_order_relaxed)) return -1;
+    int saved = errno;
+    int64_t offset = real_lseek(fd, 0, SEEK_CUR);
+    errno = saved;
+    return offset;
+}
+
+static void *drain_thread(void *arg) {
+    (void) arg;
+
+    struct timespec interval = { 0, DRAIN_INTERVAL_NS };
+    for (;;) {
+        nanosleep(&interval, NULL);
+        pthread_mutex_lock(&drain_lock);
+        if (atomic_load(&tracing)) drain();
+        pthread_mutex_unlock(&drain_lock);
+    }
+    return NULL;
+}
+
+static void stop_in_child(void) {
+    atomic_store(&tracing, 0);
+}
+
+__attribute__((constructor)) static void trace_start(void) {
+    if (!real_open) resolve();
+
+    char name[256];
+    const char *env = getenv("IOTRACE_FILE");
+    snprintf(name, sizeof(name), "%s.%d", env ? env : "iotrace", getpid());
+
+    trace_fd = real_open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace_fd < 0) {
+        perror(name);
+        return;
+    }
+    struct iotrace_header header = { IOTRACE_MAGIC, IOTRACE_VERSION, sizeof(struct iotrace_record), getpid() };
+    if (real_write(trace_fd, &header, sizeof(header)) != sizeof(header)) {
+        perror(name);
+        return;
+    }
+
+    pthread_key_create(&ring_key, release_ring);
+    pthread_atfork(NULL, NULL, stop_in_child);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, drain_thread, NULL) != 0) {
+        perror("pthread_create");
+    } else {
+        pthread_detach(thread);
+    }
+    atomic_store(&tracing, 1);
+}
+
+__attribute__((destructor)) static void trace_stop(void) {
+    if (!atomic_load(&tracing)) return;
+
+    pthread_mutex_lock(&drain_lock);
+    atomic_store(&tracing, 0);
+    drain();
+    for (struct ring *r = atomic_load(&rings); r; r = r->next) {
+        struct iotrace_record rec = { .length = atomic_load(&r->dropped), .tid = r->tid, .op = IOTRACE_DROPPED };
+        if (rec.length && real_write(trace_fd, &rec, sizeof(rec)) < 0) break;
+    }
+    close(trace_fd);
+    pthread_mutex_unlock(&drain_lock);
+}
+
+static mode_t mode_arg(int flags, va_list args) {
+    return (flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE ? va_arg(args, mode_t) : 0;
+}
+
+int open(const char *path, int flags, ...) {
+    if (!real_open) resolve();
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = mode_arg(flags, args);
+    va_end(args);
+
+    uint64_t start = now_ns();
+    int fd = real_open(path, flags, mode);
+    if (fd >= 0) trace(IOTRACE_OPEN, fd, 0, flags, start);
+    return fd;
+}
+
+int openat(int dir, const char *path, int flags, ...) {
+    if (!real_openat) resolve();
+    va_list args;
+    va_start(args, flags);
+    mode_t mode = mode_arg(flags, args);
+    va_end(args);
+
+    uint64_t start = now_ns();
+    int fd = real_openat(dir, path, flags, mode);
+    if (fd >= 0) trace(IOTRACE_OPEN, fd, 0, flags, start);
+    return fd;
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    if (!real_read) resolve();
+    int64_t offset = position(fd);
+    uint64_t start = now_ns();
+    ssize_t n = real_read(fd, buf, count);
+    trace(IOTRACE_READ, fd, offset, n, start);
+    return n;
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    if (!real_pread) resolve();
+    uint64_t start = now_ns();
+    ssize_t n = real_pread(fd, buf, count, offset);
+    trace(IOTRACE_PREAD, fd, offset, n, start);
+    return n;
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    if (!real_write) resolve();
+    int64_t offset = position(fd);
+    uint64_t start = now_ns();
+    ssize_t n = real_write(fd, buf, count);
+    trace(IOTRACE_WRITE, fd, offset, n, start);
+    return n;
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    if (!real_pwrite) resolve();
+    uint64_t start = now_ns();
+    ssize_t n = real_pwrite(fd, buf, count, offset);
+    trace(IOTRACE_PWRITE, fd, offset, n, start);
+    return n;
+}
+
+off_t lseek(int fd, off_t offset, int whence) {
+    if (!real_lseek) resolve();
+    uint64_t start = now_ns();
+    off_t result = real_lseek(fd, offset, whence);
+    trace(IOTRACE_LSEEK, fd, result, 0, start);
+    return result;
+}
+
+int fsync(int fd) {
+    if (!real_fsync) resolve();
+    uint64_t start = now_ns();
+    int result = real_fsync(fd);
+    trace(IOTRACE_FSYNC, fd, -1, result, start);
+    return result;
+}
+
+int fdatasync(int fd) {
+    if (!real_fdatasync) resolve();
+    uint64_t start = now_ns();
+    int result = real_fdatasync(fd);
+    trace(IOTRACE_FSYNC, fd, -1, result, start);
+    return result;
+}
+
+// On 64-bit glibc these are the same calls under another name
+int open64(const char *path, int flags, ...) __attribute__((alias("open")));
+int openat64(int dir, const char *path, int flags, ...) __attribute__((alias("openat")));
+ssize_t pread64(int fd, void *buf, size_t count, off_t offset) __attribute__((alias("pread")));
+ssize_t pwrite64(int fd, const void *buf, size_t count, off_t offset) __attribute__((alias("pwrite")));
+off_t lseek64(int fd, off_t offset, int whence) __attribute__((alias("lseek")));
@@ -0,0 +1,44 @@
+#ifndef IOTRACE_H
+#define IOTRACE_H
+
+#include <stdint.h>
+
+// Trace file written by iotrace.so and replayed by dofileio: a struct
+// iotrace_header, then struct iotrace_record until the end of the file.
+// As with alloctrace.h, records from different threads are interleaved in
+// the order they were drained, not by time.
+
+#define IOTRACE_MAGIC 0x52544f49   // "IOTR"
+#define IOTRACE_VERSION 1
+
+enum iotrace_op {
+    IOTRACE_OPEN = 1,   // `fd` was opened with flags `length`
+    IOTRACE_READ,       // read and write: `offset` is where the file position was
+    IOTRACE_PREAD,
+    IOTRACE_WRITE,
+    IOTRACE_PWRITE,
+    IOTRACE_LSEEK,      // `fd` was moved to `offset`
+    IOTRACE_FSYNC,
+    IOTRACE_DROPPED,    // `length` records of thread `tid` were lost to a full ring
+};
+
+struct iotrace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t pid;
+};
+
+// `length` is what the call returned: bytes moved, or -1 when it failed.
+// `offset` is -1 for descriptors that can't seek (pipes, sockets).
+struct iotrace_record {
+    uint64_t ns;        // CLOCK_MONOTONIC, when the call started
+    int64_t offset;
+    int32_t length;
+    int32_t fd;
+    uint32_t tid;
+    uint16_t op;
+    uint16_t latency_us;    // saturates at 65535
+};
+
+#endif
@@ -0,0 +1,558 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <ucontext.h>
+#include <sys/syscall.h>
+#include <sys/auxv.h>
+#include <sys/random.h>
+#include <sys/mman.h>
+#include "loader.h"
+#include "stats.h"
+#include "plan.h"
+#include "packed.h"
+#include "hugetext.h"
+
+struct loader_options options;
+
+// Who holds page_lock and how often. Threads are told apart by gettid
+// rather than by anything in TLS: in a fault handler the thread pointer
+// belongs to the loaded program's libc, not ours.
+static _Atomic pid_t lock_owner;
+static int lock_depth;
+
+void page_lock(void) {
+    pid_t self = syscall(SYS_gettid);
+    if (atomic_load(&lock_owner) == self) {
+        lock_depth++;
+        return;
+    }
+    pid_t none = 0;
+    while (!atomic_compare_exchange_weak(&lock_owner, &none, self)) {
+        none = 0;
+        sched_yield();
+    }
+    lock_depth = 1;
+}
+
+void page_unlock(void) {
+    if (--lock_depth == 0) atomic_store(&lock_owner, 0);
+}
+
+int parse_options(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "+r:p:Hj:L:")) != -1) {
+        switch (opt) {
+        case 'r':
+            options.report_path = optarg;
+            break;
+        case 'p':
+            options.plan_dir = optarg;
+            break;
+        case 'H':
+            options.record_hot = 1;
+            break;
+        case 'j':
+            options.populate_threads = atoi(optarg);
+            if (options.populate_threads < 1) return -1;
+            break;
+        case 'L':
+            options.huge_text = huge_text_mode(optarg);
+            if (options.huge_text == HUGE_TEXT_OFF) return -1;
+            break;
+        default:
+            return -1;
+        }
+    }
+    return optind < argc ? optind : -1;
+}
+
+int segment_prot(const Elf64_Phdr *phdr) {
+    int prot = 0;
+    if (phdr->p_flags & PF_R) prot |= PROT_READ;
+    if (phdr->p_flags & PF_W) prot |= PROT_WRITE;
+    if (phdr->p_flags & PF_X) prot |= PROT_EXEC;
+    return prot;
+}
+
+void reserve_image(const char *path, struct elf_image *image) {
+    uintptr_t lo = UINTPTR_MAX, hi = 0, align = PAGE_SIZE;
+    for (int i = 0; i < image->segment_count; i++) {
+        const Elf64_Phdr *phdr = &image->segments[i];
+        if (PAGE_ALIGN_DOWN(phdr->p_vaddr) < lo) lo = PAGE_ALIGN_DOWN(phdr->p_vaddr);
+        if (PAGE_ALIGN_UP(phdr->p_vaddr + phdr->p_memsz) > hi) hi = PAGE_ALIGN_UP(phdr->p_vaddr + phdr->p_memsz);
+        if (phdr->p_align > align) align = phdr->p_align;
+    }
+    size_t span = hi - lo;
+    // A huge-page-aligned bias keeps the text's own 2 MiB alignment
+    if (options.huge_text && align < HUGE_PAGE_SIZE && image->ehdr.e_type == ET_DYN) align = HUGE_PAGE_SIZE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+    if (image->ehdr.e_type == ET_EXEC) {
+        void *addr = mmap((void *)lo, span, PROT_NONE, flags | MAP_FIXED_NOREPLACE, -1, 0);
+        if (addr != (void *)lo) {
+            fprintf(stderr, "%s: address range 0x%lx-0x%lx is already in use.\n", path, lo, hi);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        // Let the kernel choose (and randomize) the base, then trim it to the segments' alignment
+        char *raw = mmap(NULL, span + align - PAGE_SIZE, PROT_NONE, flags, -1, 0);
+        if (raw == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        char *addr = (char *)(((uintptr_t)raw + align - 1) & ~(align - 1));
+        if (addr > raw) munmap(raw, addr - raw);
+        if (addr + span < raw + span + align - PAGE_SIZE) munmap(addr + span, raw + align - PAGE_SIZE - addr);
+        image->bias = (uintptr_t)addr - lo;
+    }
+
+    image->map_start = lo + image->bias;
+    image->map_end = hi + image->bias;
+    image->present = mmap(NULL, span / PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image->present == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < image->segment_count; i++) {
+        image->segments[i].p_vaddr += image->bias;
+        if (stats) stats->segment_vaddr[image->id][i] = image->segments[i].p_vaddr;
+    }
+    if (stats) stats->segment_count[image->id] = image->segment_count;
+    if (image->relro.p_type == PT_GNU_RELRO) image->relro.p_vaddr += image->bias;
+}
+
+void open_image_file(const char *path, struct elf_image *image) {
+    image->fd = open(path, O_RDONLY);
+    if (image->fd < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    image->packed = packed_open(image->fd);
+}
+
+ssize_t image_pread(struct elf_image *image, void *buf, size_t len, off_t offset) {
+    if (image->packed) return packed_read(image->packed, buf, len, offset);
+    return pread(image->fd, buf, len, offset);
+}
+
+void open_image(const char *path, int id, struct elf_image *image) {
+    memset(image, 0, sizeof(*image));
+    image->id = id;
+    image->relro.p_type = PT_NULL;
+
+    open_image_file(path, image);
+
+    Elf64_Ehdr *ehdr = &image->ehdr;
+    if (image_pread(image, ehdr, sizeof(*ehdr), 0) != sizeof(*ehdr)) {
+        perror("read");
+        exit(EXIT_FAILURE);
+    }
+
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+        ehdr->e_machine != EM_X86_64 || (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN)) {
+        fprintf(stderr, "%s: not an x86-64 ELF executable.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    // One read for the whole program header table
+    size_t table_size = ehdr->e_phnum * sizeof(Elf64_Phdr);
+    Elf64_Phdr *phdrs = alloca(table_size);
+    if (image_pread(image, phdrs, table_size, ehdr->e_phoff) != table_size) {
+        perror("read");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        Elf64_Phdr *phdr = &phdrs[i];
+        if (phdr->p_type == PT_LOAD) {
+            if (image->segment_count == MAX_PHDR_COUNT) {
+                fprintf(stderr, "%s: too many PT_LOAD segments.\n", path);
+                exit(EXIT_FAILURE);
+            }
+            if ((phdr->p_vaddr - phdr->p_offset) & (PAGE_SIZE - 1)) {
+                fprintf(stderr, "%s: segment at 0x%lx is not congruent with its file offset.\n", path, phdr->p_vaddr);
+                exit(EXIT_FAILURE);
+            }
+            image->segments[image->segment_count++] = *phdr;
+        } else if (phdr->p_type == PT_GNU_RELRO) {
+            image->relro = *phdr;
+        } else if (phdr->p_type == PT_INTERP) {
+            if (phdr->p_filesz >= sizeof(image->interp) ||
+                image_pread(image, image->interp, phdr->p_filesz, phdr->p_offset) != phdr->p_filesz) {
+                fprintf(stderr, "%s: bad PT_INTERP.\n", path);
+                exit(EXIT_FAILURE);
+            }
+            image->interp[phdr->p_filesz] = '\0';
+        }
+    }
+
+    if (image->segment_count == 0) {
+        fprintf(stderr, "%s: no PT_LOAD segments.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    reserve_image(path, image);
+}
+
+int open_images(const char *program, struct elf_image images[2]) {
+    open_image(program, 0, &images[0]);
+    if (images[0].interp[0] == '\0') return 1;
+
+    open_image(images[0].interp, 1, &images[1]);
+    if (images[1].ehdr.e_type != ET_DYN || images[1].interp[0] != '\0') {
+        fprintf(stderr, "%s: unsupported interpreter.\n", images[0].interp);
+        exit(EXIT_FAILURE);
+    }
+    return 2;
+}
+
+int load_images(const char *program, struct elf_image images[2]) {
+    if (options.plan_dir) return load_images_cached(options.plan_dir, program, images);
+    return open_images(program, images);
+}
+
+static int page_in_segment(const Elf64_Phdr *phdr, uintptr_t page) {
+    return phdr->p_memsz != 0 &&
+           page >= PAGE_ALIGN_DOWN(phdr->p_vaddr) &&
+           page < PAGE_ALIGN_UP(phdr->p_vaddr + phdr->p_memsz);
+}
+
+static int segments_on_page(const struct elf_image *image, uintptr_t page) {
+    int count = 0;
+    for (int i = 0; i < image->segment_count; i++) {
+        if (page_in_segment(&image->segments[i], page)) count++;
+    }
+    return count;
+}
+
+static void mark_present(struct elf_image *image, uintptr_t start, uintptr_t end) {
+    memset(&image->present[(start - image->map_start) / PAGE_SIZE], 1, (end - start) / PAGE_SIZE);
+}
+
+// Protections of a page: those of every segment on it, except that W^X
+// leaves a page shared by text and data with the data segment's
+// permissions, as it does when the kernel maps the data segment over it
+static int page_prot(const struct elf_image *image, uintptr_t page) {
+    int prot = 0;
+    for (int i = 0; i < image->segment_count; i++) {
+        if (page_in_segment(&image->segments[i], page)) prot |= segment_prot(&image->segments[i]);
+    }
+    if ((prot & PROT_WRITE) && (prot & PROT_EXEC)) prot &= ~PROT_EXEC;
+    return prot;
+}
+
+// Called with page_lock held
+static int fill_page(struct elf_image *image, uintptr_t page) {
+    if (page < image->map_start || page >= image->map_end) return -1;
+    if (image->present[(page - image->map_start) / PAGE_SIZE]) return 1;
+
+    const Elf64_Phdr *owner = NULL;
+    int hits = 0, direct = 1, file_bytes = 0;
+
+    for (int i = 0; i < image->segment_count; i++) {
+        const Elf64_Phdr *phdr = &image->segments[i];
+        if (!page_in_segment(phdr, page)) continue;
+
+        uintptr_t file_end = phdr->p_vaddr + phdr->p_filesz;
+        uintptr_t mem_end = phdr->p_vaddr + phdr->p_memsz;
+        // Any .bss on this page means the file view can't be used as-is
+        if (file_end < page + PAGE_SIZE && mem_end > file_end && mem_end > page) direct = 0;
+        if (file_end <= page) direct = 0;
+        if (file_end > page && phdr->p_vaddr < page + PAGE_SIZE) file_bytes = 1;
+
+        owner = phdr;
+        hits++;
+    }
+    if (hits == 0) return -1;
+    int prot = page_prot(image, page);
+
+    // Packed executables have no file pages to map, only clusters to decompress
+    if (hits == 1 && direct && !image->packed) {
+        off_t offset = PAGE_ALIGN_DOWN(owner->p_offset) + (page - PAGE_ALIGN_DOWN(owner->p_vaddr));
+        if (mmap((void *)page, PAGE_SIZE, prot, MAP_PRIVATE | MAP_FIXED, image->fd, offset) == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        if (stats) {
+            stats->file_bytes_mapped += PAGE_SIZE;
+            stats->segment_pages[image->id][owner - image->segments]++;
+        }
+        mark_present(image, page, page + PAGE_SIZE);
+        return 0;
+    }
+
+    // Pure .bss: a fresh zero page is complete the moment it is mapped
+    if (!file_bytes) {
+        if (mmap((void *)page, PAGE_SIZE, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; stats && i < image->segment_count; i++) {
+            if (page_in_segment(&image->segments[i], page)) stats->segment_pages[image->id][i]++;
+        }
+        mark_present(image, page, page + PAGE_SIZE);
+        return 0;
+    }
+
+    // Straddled or partially-.bss page: assemble it in anonymous memory off
+    // to the side and move it into place whole, so that other threads never
+    // see it half filled
+    char *scratch = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (scratch == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < image->segment_count; i++) {
+        const Elf64_Phdr *phdr = &image->segments[i];
+        if (!page_in_segment(phdr, page)) continue;
+
+        uintptr_t start = phdr->p_vaddr > page ? phdr->p_vaddr : page;
+        uintptr_t end = phdr->p_vaddr + phdr->p_filesz;
+        if (end > page + PAGE_SIZE) end = page + PAGE_SIZE;
+        if (stats) stats->segment_pages[image->id][i]++;
+        if (start >= end) continue;
+
+        ssize_t read_bytes = image_pread(image, scratch + (start - page), end - start,
+                                         phdr->p_offset + (start - phdr->p_vaddr));
+        if (read_bytes < 0) {
+            perror("pread");
+            exit(EXIT_FAILURE);
+        }
+        if (stats) stats->file_bytes_read += read_bytes;
+    }
+
+    if (mprotect(scratch, PAGE_SIZE, prot) != 0) {
+        perror("mprotect");
+        exit(EXIT_FAILURE);
+    }
+    if (mremap(scratch, PAGE_SIZE, PAGE_SIZE, MREMAP_MAYMOVE | MREMAP_FIXED, (void *)page) == MAP_FAILED) {
+        perror("mremap");
+        exit(EXIT_FAILURE);
+    }
+    mark_present(image, page, page + PAGE_SIZE);
+    return 0;
+}
+
+// A packed page costs a whole cluster's decompression, so fill in every page
+// of the segment that the same cluster holds while it is at hand
+static void fill_cluster(struct elf_image *image, uintptr_t page) {
+    size_t cluster_size = image->packed->header.cluster_size;
+
+    for (int i = 0; i < image->segment_count; i++) {
+        const Elf64_Phdr *phdr = &image->segments[i];
+        uintptr_t seg_start = PAGE_ALIGN_DOWN(phdr->p_vaddr);
+        uintptr_t file_hi = PAGE_ALIGN_UP(phdr->p_vaddr + phdr->p_filesz);
+        if (page < seg_start || page >= file_hi) continue;
+
+        off_t offset = PAGE_ALIGN_DOWN(phdr->p_offset) + (page - seg_start);
+        uintptr_t first = page - offset % cluster_size;
+        for (uintptr_t sibling = first; sibling < first + cluster_size; sibling += PAGE_SIZE) {
+            if (sibling >= seg_start && sibling < file_hi) fill_page(image, sibling);
+        }
+        return;
+    }
+}
+
+int map_page(struct elf_image *image, uintptr_t page) {
+    page_lock();
+    int ret = fill_page(image, page);
+    if (ret == 0 && image->packed) fill_cluster(image, page);
+    page_unlock();
+    return ret;
+}
+
+int fault_allowed(const struct elf_image *image, uintptr_t page, const void *context) {
+    // x86-64 page fault error code: bit 1 is a write, bit 4 an instruction fetch
+    unsigned long error = ((const ucontext_t *)context)->uc_mcontext.gregs[REG_ERR];
+    int prot = page_prot(image, page);
+    if (error & 0x2) return (prot & PROT_WRITE) != 0;
+    if (error & 0x10) return (prot & PROT_EXEC) != 0;
+    return (prot & PROT_READ) != 0;
+}
+
+void map_segment(struct elf_image *image, int index) {
+    const Elf64_Phdr *phdr = &image->segments[index];
+    if (phdr->p_memsz == 0) return;
+
+    int prot = segment_prot(phdr);
+    uintptr_t seg_start = PAGE_ALIGN_DOWN(phdr->p_vaddr);
+    uintptr_t lo = seg_start;
+    uintptr_t hi = PAGE_ALIGN_UP(phdr->p_vaddr + phdr->p_memsz);
+    uintptr_t file_end = phdr->p_vaddr + phdr->p_filesz;
+
+    // Pages shared with a neighbouring segment need both segments' contents
+    if (segments_on_page(image, lo) > 1) {
+        map_page(image, lo);
+        lo += PAGE_SIZE;
+    }
+    if (hi > lo && segments_on_page(image, hi - PAGE_SIZE) > 1) {
+        hi -= PAGE_SIZE;
+        map_page(image, hi);
+    }
+
+    uintptr_t file_hi = PAGE_ALIGN_DOWN(file_end);
+    if (file_hi > hi) file_hi = hi;
+    if (file_hi > lo && image->packed) {
+        map_range(image, lo, file_hi);
+        lo = file_hi;
+    } else if (file_hi > lo) {
+        if (mmap((void *)lo, file_hi - lo, prot, MAP_PRIVATE | MAP_FIXED, image->fd,
+                 PAGE_ALIGN_DOWN(phdr->p_offset) + (lo - seg_start)) == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        if (stats) {
+            stats->file_bytes_mapped += file_hi - lo;
+            stats->segment_pages[image->id][index] += (file_hi - lo) / PAGE_SIZE;
+        }
+        mark_present(image, lo, file_hi);
+        lo = file_hi;
+    }
+
+    // The last file page may end mid-page with .bss after it
+    if (lo < hi && file_end > lo) {
+        map_page(image, lo);
+        lo += PAGE_SIZE;
+    }
+
+    if (lo < hi) {
+        if (mmap((void *)lo, hi - lo, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+        if (stats) stats->segment_pages[image->id][index] += (hi - lo) / PAGE_SIZE;
+        mark_present(image, lo, hi);
+    }
+}
+
+void map_range(struct elf_image *image, uintptr_t start, uintptr_t end) {
+    for (uintptr_t page = PAGE_ALIGN_DOWN(start); page < end; page += PAGE_SIZE) {
+        map_page(image, page);
+    }
+}
+
+static Elf64_Addr phdr_address(const struct elf_image *image) {
+    for (int i = 0; i < image->segment_count; i++) {
+        const Elf64_Phdr *phdr = &image->segments[i];
+        if (image->ehdr.e_phoff >= phdr->p_offset && image->ehdr.e_phoff < phdr->p_offset + phdr->p_filesz) {
+            return phdr->p_vaddr + (image->ehdr.e_phoff - phdr->p_offset);
+        }
+    }
+    return 0;
+}
+
+void image_load_info(const struct elf_image *images, int count, const char *execfn, struct load_info *info) {
+    const struct elf_image *program = &images[0];
+    info->entry = program->ehdr.e_entry + program->bias;
+    info->phdr = phdr_address(program);
+    info->phnum = program->ehdr.e_phnum;
+    info->base = count > 1 ? images[1].bias : 0;
+    info->start = count > 1 ? images[1].ehdr.e_entry + images[1].bias : info->entry;
+    info->execfn = execfn;
+}
+
+static char *push_bytes(char **sp, const void *data, size_t len) {
+    *sp -= len;
+    memcpy(*sp, data, len);
+    return *sp;
+}
+
+void *setup_stack(int argc, char *argv[], char *envp[], const struct load_info *info) {
+    char *stack = mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) {
+        perror("mmap stack");
+        exit(EXIT_FAILURE);
+    }
+
+    int envc;
+    for (envc = 0; envp[envc] != NULL; envc++);
+
+    // Strings and AT_RANDOM bytes go at the very top, as the kernel lays them out
+    char *sp = stack + STACK_SIZE;
+    unsigned char random_bytes[16];
+    if (getrandom(random_bytes, sizeof(random_bytes), 0) != sizeof(random_bytes)) {
+        perror("getrandom");
+        exit(EXIT_FAILURE);
+    }
+    char *at_random = push_bytes(&sp, random_bytes, sizeof(random_bytes));
+    char *at_platform = push_bytes(&sp, "x86_64", sizeof("x86_64"));
+    char *at_execfn = push_bytes(&sp, info->execfn, strlen(info->execfn) + 1);
+
+    char **env_strings = (char **)alloca((envc + 1) * sizeof(char *));
+    for (int i = envc - 1; i >= 0; i--) {
+        env_strings[i] = push_bytes(&sp, envp[i], strlen(envp[i]) + 1);
+    }
+    char **arg_strings = (char **)alloca((argc + 1) * sizeof(char *));
+    for (int i = argc - 1; i >= 0; i--) {
+        arg_strings[i] = push_bytes(&sp, argv[i], strlen(argv[i]) + 1);
+    }
+
+    Elf64_auxv_t auxv[] = {
+        { AT_SYSINFO_EHDR, { getauxval(AT_SYSINFO_EHDR) } },
+        { AT_MINSIGSTKSZ,  { getauxval(AT_MINSIGSTKSZ) } },
+        { AT_HWCAP,        { getauxval(AT_HWCAP) } },
+        { AT_PAGESZ,       { PAGE_SIZE } },
+        { AT_CLKTCK,       { getauxval(AT_CLKTCK) } },
+        { AT_PHDR,         { info->phdr } },
+        { AT_PHENT,        { sizeof(Elf64_Phdr) } },
+        { AT_PHNUM,        { info->phnum } },
+        { AT_BASE,         { info->base } },
+        { AT_FLAGS,        { 0 } },
+        { AT_ENTRY,        { info->entry } },
+        { AT_UID,          { getuid() } },
+        { AT_EUID,         { geteuid() } },
+        { AT_GID,          { getgid() } },
+        { AT_EGID,         { getegid() } },
+        { AT_SECURE,       { 0 } },
+        { AT_RANDOM,       { (uintptr_t)at_random } },
+        { AT_HWCAP2,       { getauxval(AT_HWCAP2) } },
+        { AT_EXECFN,       { (uintptr_t)at_execfn } },
+        { AT_PLATFORM,     { (uintptr_t)at_platform } },
+        { AT_NULL,         { 0 } },
+    };
+
+    // argc, argv[], NULL, envp[], NULL, auxv; %rsp must be 16-byte aligned at entry
+    size_t words = 1 + (argc + 1) + (envc + 1) + 2 * (sizeof(auxv) / sizeof(auxv[0]));
+    sp = (char *)((uintptr_t)sp & ~0xF);
+    if (words & 1) sp -= sizeof(uint64_t);
+    sp -= words * sizeof(uint64_t);
+
+    uint64_t *slot = (uint64_t *)sp;
+    *slot++ = argc;
+    for (int i = 0; i < argc; i++) *slot++ = (uintptr_t)arg_strings[i];
+    *slot++ = 0;
+    for (int i = 0; i < envc; i++) *slot++ = (uintptr_t)env_strings[i];
+    *slot++ = 0;
+    memcpy(slot, auxv, sizeof(auxv));
+
+    return sp;
+}
+
+void start_program(void *stack_top, Elf64_Addr entry) {
+    if (stats) stats->startup_ns = now_ns() - stats->start_ns;
+
+    // Zero all registers and jump to the entry point. %rdx is the rtld_fini
+    // pointer _start hands to atexit, so it has to be NULL as well.
+    asm volatile(
+        "mov %0, %%rsp\n"
+        "xor %%rax, %%rax\n"
+        "xor %%rbx, %%rbx\n"
+        "xor %%rcx, %%rcx\n"
+        "xor %%rdx, %%rdx\n"
+        "xor %%rdi, %%rdi\n"
+        "xor %%rbp, %%rbp\n"
+        "jmp *%1\n"
+        :
+        : "D"(stack_top), "S"(entry)
+        : "memory"
+    );
+    __builtin_unreachable();
+}
@@ -0,0 +1,119 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <elf.h>
+
+// Shared ELF mapping helpers for apager, dpager and hpager
+
+#define PAGE_SIZE 4096
+#define PAGE_ALIGN_DOWN(x) ((x) & ~(uintptr_t)(PAGE_SIZE - 1))
+#define PAGE_ALIGN_UP(x) (((x) + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1))
+#define STACK_SIZE (8 * 1024 * 1024)
+#define MAX_PHDR_COUNT 16
+
+struct packed_file;
+
+// An executable or its interpreter, reserved in memory and ready to be paged in
+struct elf_image {
+    int id;                                 // 0 for the program, 1 for its interpreter
+    int fd;
+    struct packed_file *packed;             // set when the file is a packed executable
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr segments[MAX_PHDR_COUNT];    // PT_LOADs, p_vaddr already relocated by bias
+    int segment_count;
+    Elf64_Phdr relro;                       // PT_GNU_RELRO (relocated), p_type PT_NULL if none
+    Elf64_Addr bias;                        // load bias, 0 for ET_EXEC
+    uintptr_t map_start, map_end;           // reserved address range
+    unsigned char *present;                 // one byte per page of the range: mapped yet?
+    char interp[PATH_MAX];                  // PT_INTERP, empty for static executables
+};
+
+// What the initial process stack needs to know about the loaded image
+struct load_info {
+    Elf64_Addr entry;       // AT_ENTRY: the program's own entry point
+    Elf64_Addr phdr;        // AT_PHDR: program headers as mapped in memory
+    int phnum;              // AT_PHNUM
+    Elf64_Addr base;        // AT_BASE: interpreter load address, 0 if none
+    Elf64_Addr start;       // where to jump: the interpreter's entry, or AT_ENTRY
+    const char *execfn;     // AT_EXECFN
+};
+
+// Loader command-line options, shared by all pagers
+struct loader_options {
+    const char *report_path;    // -r: write a stats report when the program exits
+    const char *plan_dir;       // -p: cache load plans in this directory
+    int record_hot;             // -H: record demand-faulted pages into the plan
+    int populate_threads;       // -j: populate segments eagerly with this many threads
+    int huge_text;              // -L: enum huge_text_mode, text on 2 MiB pages
+};
+
+extern struct loader_options options;
+
+// Serialize page fills, so that threads faulting on the same page don't
+// both map it. Recursive: fault handlers hold it around map_page. Only
+// the signal handler's own signal mask keeps it from being interrupted.
+void page_lock(void);
+void page_unlock(void);
+
+// Parse the options in front of the program path. Returns the index of the
+// program in argv, or -1 on a bad option or missing program.
+int parse_options(int argc, char *argv[]);
+
+// Open an executable, plain or packed (see packed.h)
+void open_image_file(const char *path, struct elf_image *image);
+
+// pread() on the executable, decompressing packed ones
+ssize_t image_pread(struct elf_image *image, void *buf, size_t len, off_t offset);
+
+// Open and validate an ELF executable and reserve its address range. ET_DYN
+// images get a randomized load bias; ET_EXEC ones must fit where linked.
+// `id` is 0 for the program and 1 for its interpreter.
+void open_image(const char *path, int id, struct elf_image *image);
+
+// Reserve the image's whole address range PROT_NONE so nothing else lands in
+// the holes a demand pager hasn't filled yet, and apply the load bias
+void reserve_image(const char *path, struct elf_image *image);
+
+// Open the program and, if it has a PT_INTERP, its dynamic linker.
+// Returns the number of images (1 or 2); images[0] is always the program.
+int open_images(const char *program, struct elf_image images[2]);
+
+// open_images, going through the load plan cache when -p was given
+int load_images(const char *program, struct elf_image images[2]);
+
+// PROT_* bits for a segment's p_flags
+int segment_prot(const Elf64_Phdr *phdr);
+
+// Map the single page at `page` with the contents and protections of every
+// PT_LOAD in the image that covers it. Returns 0 when it maps the page, 1 when
+// the page was already mapped and -1 when no segment of the image covers it.
+int map_page(struct elf_image *image, uintptr_t page);
+
+// Whether the access that faulted on the mapped `page` is one its
+// protections allow, from the signal handler's `context`. If so, the fault
+// lost a race with another thread's map_page and the access can be retried.
+int fault_allowed(const struct elf_image *image, uintptr_t page, const void *context);
+
+// Eagerly map all of image->segments[index]: bulk file-backed and anonymous
+// ranges, with shared or partial edge pages going through map_page.
+void map_segment(struct elf_image *image, int index);
+
+// map_page every page in [start, end). Demand pagers use it for the
+// PT_GNU_RELRO range, which libc mprotects before the program touches it.
+void map_range(struct elf_image *image, uintptr_t start, uintptr_t end);
+
+// Fill in the auxv values and the jump target for the loaded images
+void image_load_info(const struct elf_image *images, int count, const char *execfn, struct load_info *info);
+
+// Allocate a stack and lay out argc, argv, envp, auxv and the strings they
+// point to as the System V x86-64 ABI expects at process entry. `argv` is
+// the loaded program's argv (argv[0] is its path). Returns the initial %rsp.
+void *setup_stack(int argc, char *argv[], char *envp[], const struct load_info *info);
+
+// Switch to the new stack and jump to `entry` with the registers _start expects
+void start_program(void *stack_top, Elf64_Addr entry) __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,139 @@
+#include <stdint.h>
+#include <string.h>
+#include "lz4.h"
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5     // the block always ends with at least this many literals
+#define MF_LIMIT 12         // and no match may start closer than this to the end
+#define MAX_OFFSET 65535
+#define HASH_LOG 12
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+    return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+// Lengths of 15 and up continue in 255-valued bytes after the token
+static int put_length(unsigned char **op, unsigned char *end, int len) {
+    for (; len >= 255; len -= 255) {
+        if (*op >= end) return -1;
+        *(*op)++ = 255;
+    }
+    if (*op >= end) return -1;
+    *(*op)++ = len;
+    return 0;
+}
+
+static int put_sequence(unsigned char **op, unsigned char *end, const unsigned char *literals,
+                        int literal_len, int offset, int match_len) {
+    if (*op >= end) return -1;
+    unsigned char *token = (*op)++;
+    *token = (literal_len >= 15 ? 15 : literal_len) << 4;
+    if (literal_len >= 15 && put_length(op, end, literal_len - 15) < 0) return -1;
+
+    if (end - *op < literal_len) return -1;
+    memcpy(*op, literals, literal_len);
+    *op += literal_len;
+
+    // The last sequence is literals only
+    if (match_len == 0) return 0;
+
+    if (end - *op < 2) return -1;
+    *(*op)++ = offset & 0xff;
+    *(*op)++ = offset >> 8;
+
+    match_len -= MIN_MATCH;
+    *token |= match_len >= 15 ? 15 : match_len;
+    if (match_len >= 15 && put_length(op, end, match_len - 15) < 0) return -1;
+    return 0;
+}
+
+int lz4_compress(const unsigned char *src, int len, unsigned char *dst, int capacity) {
+    uint32_t table[1 << HASH_LOG];  // last position + 1 seen for each hash, 0 if none
+    unsigned char *op = dst, *end = dst + capacity;
+    int anchor = 0, ip = 0;
+
+    memset(table, 0, sizeof(table));
+    while (ip < len - MF_LIMIT) {
+        uint32_t sequence = read32(src + ip);
+        uint32_t h = hash4(sequence);
+        int ref = (int)table[h] - 1;
+        table[h] = ip + 1;
+
+        if (ref < 0 || ip - ref > MAX_OFFSET || read32(src + ref) != sequence) {
+            ip++;
+            continue;
+        }
+
+        int match_len = MIN_MATCH;
+        while (ip + match_len < len - LAST_LITERALS && src[ref + match_len] == src[ip + match_len]) {
+            match_len++;
+        }
+
+        if (put_sequence(&op, end, src + anchor, ip - anchor, ip - ref, match_len) < 0) return -1;
+        ip += match_len;
+        anchor = ip;
+    }
+
+    if (put_sequence(&op, end, src + anchor, len - anchor, 0, 0) < 0) return -1;
+    return op - dst;
+}
+
+static int get_length(const unsigned char **ip, const unsigned char *end, int *len) {
+    unsigned char b;
+    do {
+        if (*ip >= end) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz4_decompress(const unsigned char *src, int len, unsigned char *dst, int capacity) {
+    const unsigned char *ip = src, *end = src + len;
+    unsigned char *op = dst, *out_end = dst + capacity;
+
+    while (ip < end) {
+        unsigned char token = *ip++;
+
+        int literal_len = token >> 4;
+        if (literal_len == 15 && get_length(&ip, end, &literal_len) < 0) return -1;
+        if (end - ip < literal_len || out_end - op < literal_len) return -1;
+        // Short runs are copied 16 bytes at a time when both buffers have room to spare
+        if (literal_len <= 16 && end - ip >= 16 && out_end - op >= 16) {
+            memcpy(op, ip, 16);
+        } else {
+            memcpy(op, ip, literal_len);
+        }
+        ip += literal_len;
+        op += literal_len;
+
+        if (ip == end) break;
+
+        if (end - ip < 2) return -1;
+        int offset = ip[0] | ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > op - dst) return -1;
+
+        int match_len = token & 15;
+        if (match_len == 15 && get_length(&ip, end, &match_len) < 0) return -1;
+        match_len += MIN_MATCH;
+        if (out_end - op < match_len) return -1;
+
+        // Matches may overlap their own output. With an offset of at least 8,
+        // 8-byte chunks never read bytes they haven't written yet.
+        const unsigned char *match = op - offset;
+        if (offset >= 8 && out_end - op >= match_len + 8) {
+            for (int i = 0; i < match_len; i += 8) memcpy(op + i, match + i, 8);
+        } else {
+            for (int i = 0; i < match_len; i++) op[i] = match[i];
+        }
+        op += match_len;
+    }
+    return op - dst;
+}
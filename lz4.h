@@ -0,0 +1,18 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+// Minimal codec for the LZ4 block format (no frame header or checksums).
+// Blocks it writes can be read by LZ4_decompress_safe() and vice versa.
+
+// Worst-case compressed size for `len` input bytes
+#define LZ4_BOUND(len) ((len) + (len) / 255 + 16)
+
+// Compress `len` bytes into `dst`. Returns the compressed size, or -1 if it
+// doesn't fit in `capacity`.
+int lz4_compress(const unsigned char *src, int len, unsigned char *dst, int capacity);
+
+// Decompress a block. Returns the decompressed size, or -1 on a corrupt block
+// or if the output would exceed `capacity`. Safe to call from a signal handler.
+int lz4_decompress(const unsigned char *src, int len, unsigned char *dst, int capacity);
+
+#endif
@@ -7,11 +7,129 @@
 #include <unistd.h>
 #include <time.h>
 #include <stdint.h>
+#include <errno.h>
 #include <cstring>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #define PAGE_SIZE 4096
 #define NUM_PAGES (1024*1024*1024/PAGE_SIZE)
 
+// Counters read around each phase. clock() alone is CPU time, so time spent
+// blocked in msync writeback never showed up; wall time and context
+// switches do show it. Without perf_event_open (perf_event_paranoid,
+// containers) faults and context switches come from getrusage, and the
+// TLB counts are missing.
+enum counter {
+    MINOR_FAULTS,
+    MAJOR_FAULTS,
+    DTLB_LOAD_MISSES,
+    DTLB_STORE_MISSES,
+    CONTEXT_SWITCHES,
+    COUNTER_COUNT
+};
+
+static const char* counter_names[COUNTER_COUNT] = { "minflt", "majflt", "dTLB-ld-miss", "dTLB-st-miss", "ctxsw" };
+static int counter_fds[COUNTER_COUNT];
+static int have_perf;
+
+struct snapshot {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t counts[COUNTER_COUNT];
+    int valid[COUNTER_COUNT];
+};
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Count this process, falling back to user space only when the kernel
+// won't let us count it too
+static int open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.inherit = 1;
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    return fd;
+}
+
+static void open_counters() {
+    uint64_t dtlb_miss = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    counter_fds[MINOR_FAULTS] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN);
+    counter_fds[MAJOR_FAULTS] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ);
+    counter_fds[DTLB_LOAD_MISSES] = open_counter(PERF_TYPE_HW_CACHE, dtlb_miss | (PERF_COUNT_HW_CACHE_OP_READ << 8));
+    counter_fds[DTLB_STORE_MISSES] = open_counter(PERF_TYPE_HW_CACHE, dtlb_miss | (PERF_COUNT_HW_CACHE_OP_WRITE << 8));
+    counter_fds[CONTEXT_SWITCHES] = open_counter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (counter_fds[c] >= 0) have_perf = 1;
+    }
+    if (!have_perf) {
+        fprintf(stderr, "perf_event_open: %s; using getrusage\n", strerror(errno));
+    }
+}
+
+static void take_snapshot(struct snapshot* snap) {
+    memset(snap, 0, sizeof(*snap));
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (counter_fds[c] >= 0) {
+            snap->valid[c] = read(counter_fds[c], &snap->counts[c], sizeof(uint64_t)) == sizeof(uint64_t);
+        }
+    }
+    // getrusage fills in whatever perf couldn't count
+    if (!snap->valid[MINOR_FAULTS]) {
+        snap->counts[MINOR_FAULTS] = usage.ru_minflt;
+        snap->valid[MINOR_FAULTS] = 1;
+    }
+    if (!snap->valid[MAJOR_FAULTS]) {
+        snap->counts[MAJOR_FAULTS] = usage.ru_majflt;
+        snap->valid[MAJOR_FAULTS] = 1;
+    }
+    if (!snap->valid[CONTEXT_SWITCHES]) {
+        snap->counts[CONTEXT_SWITCHES] = usage.ru_nvcsw + usage.ru_nivcsw;
+        snap->valid[CONTEXT_SWITCHES] = 1;
+    }
+    snap->cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    snap->wall_ns = clock_ns(CLOCK_MONOTONIC);
+}
+
+static void print_header() {
+    printf("%-8s %10s %10s", "phase", "wall ms", "cpu ms");
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        printf(" %13s", counter_names[c]);
+    }
+    printf("\n");
+}
+
+// One row: what changed since `start`
+static void print_phase(const char* phase, const struct snapshot* start) {
+    struct snapshot end;
+    take_snapshot(&end);
+    printf("%-8s %10.2f %10.2f", phase, (end.wall_ns - start->wall_ns) / 1e6, (end.cpu_ns - start->cpu_ns) / 1e6);
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (start->valid[c] && end.valid[c]) {
+            printf(" %13llu", (unsigned long long)(end.counts[c] - start->counts[c]));
+        } else {
+            printf(" %13s", "-");
+        }
+    }
+    printf("\n");
+}
+
 void shuffle(uint64_t* array, size_t n) {
     if (n > 1) {
         size_t i;
@@ -44,6 +162,11 @@ int main(int argc, char* argv[]) {
     srand(time(NULL)); 
     shuffle(pages, NUM_PAGES);
 
+    open_counters();
+    print_header();
+    struct snapshot phase;
+    take_snapshot(&phase);
+
     if (strcmp(mode, "fb_private") == 0) {
         fd = open(path, O_RDWR);
         flags = MAP_PRIVATE;
@@ -70,24 +193,34 @@ int main(int argc, char* argv[]) {
         perror("mmap");
         exit(2);
     }
+    print_phase("map", &phase);
 
     clock_t start_time = clock();
+    uint64_t start_wall = clock_ns(CLOCK_MONOTONIC);
 
+    take_snapshot(&phase);
     for (uint64_t i = 0; i < NUM_PAGES; i++) {
         region[pages[i] * PAGE_SIZE] = 'a';
     }
+    print_phase("touch", &phase);
 
+    take_snapshot(&phase);
     if (msync(region, 1024 * 1024 * 1024, MS_SYNC) < 0) {
         perror("msync");
         exit(3);
     }
+    print_phase("sync", &phase);
 
     clock_t end_time = clock();
     double elapsed_time = (double)(end_time - start_time) / CLOCKS_PER_SEC;
-    printf("Elapsed time for %s: %f seconds\n", mode, elapsed_time);
+    double elapsed_wall = (clock_ns(CLOCK_MONOTONIC) - start_wall) / 1e9;
 
+    take_snapshot(&phase);
     munmap(region, 1024 * 1024 * 1024);
     if (fd != -1) close(fd);
+    print_phase("unmap", &phase);
+
+    printf("Elapsed time for %s: %f seconds (%f wall)\n", mode, elapsed_time, elapsed_wall);
 
     return 0;
 }
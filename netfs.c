@@ -1,99 +1,662 @@
-#define FUSE_USE_VERSION 30
-#include <fuse.h>
+#define FUSE_USE_VERSION 34
+#include <fuse_lowlevel.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include "netfs_client.h"
+#include "netfs_cache.h"
+#include "netfs_meta.h"
+#include "netfs_whole.h"
+
+#define INODE_BUCKETS 4096
+
+// The low-level API names files by inode number; the server names them by
+// path. Every inode the kernel knows about maps to its path here until the
+// kernel forgets it.
+struct inode {
+    fuse_ino_t ino;
+    char *path;
+    uint64_t nlookup;
+    struct inode *ino_next, *path_next;     // hash chains
+};
+
+// An open directory: the listing as of opendir, as READDIR records
+struct dir_handle {
+    char *records;
+    size_t len;
+};
 
 static const char *remote_server = NULL;
+static double attr_timeout = 1.0;
+static int whole_files = 0;             // -w: cache whole files from open to close
 
-static int run_cmd(const char *cmd) {
-    int res = system(cmd);
-    if (res != 0) {
-        return -EIO; // Input/output error
+static pthread_mutex_t inode_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct inode *ino_buckets[INODE_BUCKETS];
+static struct inode *path_buckets[INODE_BUCKETS];
+static fuse_ino_t next_ino = FUSE_ROOT_ID + 1;
+static struct inode root_inode = { .ino = FUSE_ROOT_ID, .path = "/", .nlookup = 1 };
+
+static unsigned path_hash(const char *path) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char *p = path; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash % INODE_BUCKETS;
+}
+
+// The path of `ino`, copied into `path`. Returns 0, or -ESTALE.
+static int inode_path(fuse_ino_t ino, char *path, size_t len) {
+    pthread_mutex_lock(&inode_lock);
+    struct inode *inode = ino == FUSE_ROOT_ID ? &root_inode : ino_buckets[ino % INODE_BUCKETS];
+    while (inode && inode->ino != ino) inode = inode->ino_next;
+    if (inode) snprintf(path, len, "%s", inode->path);
+    pthread_mutex_unlock(&inode_lock);
+    return inode ? 0 : -ESTALE;
+}
+
+// Find or make the inode for `path` and count one more kernel reference
+static fuse_ino_t inode_lookup(const char *path) {
+    if (strcmp(path, "/") == 0) return FUSE_ROOT_ID;
+
+    pthread_mutex_lock(&inode_lock);
+    unsigned bucket = path_hash(path);
+    struct inode *inode = path_buckets[bucket];
+    while (inode && strcmp(inode->path, path) != 0) inode = inode->path_next;
+    if (!inode) {
+        inode = calloc(1, sizeof(*inode));
+        inode->ino = next_ino++;
+        inode->path = strdup(path);
+        inode->path_next = path_buckets[bucket];
+        path_buckets[bucket] = inode;
+        inode->ino_next = ino_buckets[inode->ino % INODE_BUCKETS];
+        ino_buckets[inode->ino % INODE_BUCKETS] = inode;
+    }
+    inode->nlookup++;
+    fuse_ino_t ino = inode->ino;
+    pthread_mutex_unlock(&inode_lock);
+    return ino;
+}
+
+static void inode_forget(fuse_ino_t ino, uint64_t nlookup) {
+    if (ino == FUSE_ROOT_ID) return;
+
+    pthread_mutex_lock(&inode_lock);
+    struct inode **p = &ino_buckets[ino % INODE_BUCKETS];
+    while (*p && (*p)->ino != ino) p = &(*p)->ino_next;
+    struct inode *inode = *p;
+    if (inode) inode->nlookup = nlookup < inode->nlookup ? inode->nlookup - nlookup : 0;
+    if (inode && inode->nlookup == 0) {
+        *p = inode->ino_next;
+        struct inode **q = &path_buckets[path_hash(inode->path)];
+        while (*q != inode) q = &(*q)->path_next;
+        *q = inode->path_next;
+        free(inode->path);
+        free(inode);
+    }
+    pthread_mutex_unlock(&inode_lock);
+}
+
+static int child_path(const char *parent, const char *name, char *path, size_t len) {
+    if (snprintf(path, len, "%s/%s", strcmp(parent, "/") == 0 ? "" : parent, name) >= len) {
+        return -ENAMETOOLONG;
     }
     return 0;
 }
 
-static int netfs_getattr(const char *path, struct stat *stbuf) {
-    char cmd[1024];
+// Fresh attributes from the server, with unflushed writes accounted for
+static void remember_attr(const char *path, const struct netfs_attr *attr, struct stat *stbuf) {
+    attr_to_stat(attr, stbuf);
+    if (whole_files) {
+        whole_update_attr(path, stbuf);
+    } else {
+        cache_update_attr(path, stbuf);
+    }
+    meta_store(path, stbuf);
+}
 
-    snprintf(cmd, sizeof(cmd), "scp %s:%s /tmp/netfs_tempfile", remote_server, path);
-    int res = run_cmd(cmd);
+static int get_attr(const char *path, struct stat *stbuf) {
+    int res = meta_lookup(path, stbuf);
     if (res != 0) {
+        return res < 0 ? res : 0;
+    }
+
+    struct netfs_attr attr;
+    res = remote_call(NETFS_STAT, path, 0, 0, NULL, &attr, sizeof(attr));
+    if (res == -ENOENT) {
+        meta_store_negative(path);
+    }
+    if (res < 0) {
         return res;
     }
 
-    return lstat("/tmp/netfs_tempfile", stbuf);
+    remember_attr(path, &attr, stbuf);
+    return 0;
 }
 
-static int netfs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
-    FILE *f;
-    char cmd[1024];
+// The whole listing, as READDIR records, from the cache or the server
+static void *list_dir(const char *path, size_t *len) {
+    void *records = meta_lookup_dir(path, len);
+    if (records) {
+        return records;
+    }
 
-    (void) fi;
+    size_t capacity = 64 * 1024;
+    records = malloc(capacity);
+    *len = 0;
+    uint64_t next = 0;
+    for (;;) {
+        if (capacity - *len < 64 * 1024) {
+            capacity *= 2;
+            records = realloc(records, capacity);
+        }
+        int count = remote_call(NETFS_READDIR, path, next, capacity - *len, NULL,
+                                (char *)records + *len, capacity - *len);
+        if (count < 0) {
+            free(records);
+            errno = -count;
+            return NULL;
+        }
+        if (count == 0) {
+            break;
+        }
 
-    snprintf(cmd, sizeof(cmd), "scp %s:%s /tmp/netfs_tempfile", remote_server, path);
-    int res = run_cmd(cmd);
-    if (res != 0) {
-        return res;
+        // Find where this batch ends
+        for (int i = 0; i < count; i++) {
+            const struct netfs_dirent *dirent = (const struct netfs_dirent *)((char *)records + *len);
+            *len += NETFS_DIRENT_SIZE(dirent->name_len);
+        }
+        next += count;
+    }
+
+    meta_store_dir(path, records, *len);
+    return records;
+}
+
+static struct cache_handle *handle_of(struct fuse_file_info *fi) {
+    return (struct cache_handle *)(uintptr_t)fi->fh;
+}
+
+static struct whole_file *whole_of(struct fuse_file_info *fi) {
+    return (struct whole_file *)(uintptr_t)fi->fh;
+}
+
+// Reply to a lookup or create of `path` whose attributes are in `st`
+static void fill_entry(const char *path, struct stat *st, struct fuse_entry_param *entry) {
+    memset(entry, 0, sizeof(*entry));
+    entry->ino = inode_lookup(path);
+    st->st_ino = entry->ino;
+    entry->attr = *st;
+    entry->attr_timeout = attr_timeout;
+    entry->entry_timeout = attr_timeout;
+}
+
+static void netfs_init(void *userdata, struct fuse_conn_info *conn) {
+    (void) userdata;
+
+    conn->max_write = CACHE_MAX_READ;
+    conn->max_readahead = CACHE_MAX_READ;
+    // Writes are cached locally anyway; let the kernel batch them into big ones
+    if (conn->capable & FUSE_CAP_WRITEBACK_CACHE) {
+        conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+    }
+    // Reads are answered by splicing out of the block file
+    if (conn->capable & FUSE_CAP_SPLICE_WRITE) {
+        conn->want |= FUSE_CAP_SPLICE_WRITE;
+    }
+    if (conn->capable & FUSE_CAP_SPLICE_MOVE) {
+        conn->want |= FUSE_CAP_SPLICE_MOVE;
+    }
+
+    if (whole_files) {
+        // An open that truncates needn't fetch what it is about to discard
+        if (conn->capable & FUSE_CAP_ATOMIC_O_TRUNC) {
+            conn->want |= FUSE_CAP_ATOMIC_O_TRUNC;
+        }
+    } else {
+        cache_start();
     }
+}
+
+static void netfs_destroy(void *userdata) {
+    (void) userdata;
 
-    f = fopen("/tmp/netfs_tempfile", "rb");
-    if (f == NULL) {
-        return -errno;
+    if (whole_files) {
+        whole_shutdown(stderr);
+    } else {
+        cache_shutdown(stderr);
     }
+    meta_report(stderr);
+}
 
-    fseek(f, offset, SEEK_SET);
-    res = fread(buf, 1, size, f);
-    fclose(f);
+static void netfs_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    char dir[PATH_MAX], path[PATH_MAX];
+    int res = inode_path(parent, dir, sizeof(dir));
+    if (res == 0) res = child_path(dir, name, path, sizeof(path));
+    struct stat st;
+    if (res == 0) res = get_attr(path, &st);
 
-    return res;
+    struct fuse_entry_param entry;
+    if (res == -ENOENT) {
+        // A zero inode with a timeout is a negative entry the kernel caches too
+        memset(&entry, 0, sizeof(entry));
+        entry.entry_timeout = attr_timeout;
+        fuse_reply_entry(req, &entry);
+    } else if (res < 0) {
+        fuse_reply_err(req, -res);
+    } else {
+        fill_entry(path, &st, &entry);
+        fuse_reply_entry(req, &entry);
+    }
 }
 
-static int netfs_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
-    FILE *f;
-    char cmd[1024];
+static void netfs_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
+    inode_forget(ino, nlookup);
+    fuse_reply_none(req);
+}
+
+static void netfs_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data *forgets) {
+    for (size_t i = 0; i < count; i++) {
+        inode_forget(forgets[i].ino, forgets[i].nlookup);
+    }
+    fuse_reply_none(req);
+}
 
+static void netfs_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
     (void) fi;
 
-    snprintf(cmd, sizeof(cmd), "scp %s:%s /tmp/netfs_tempfile", remote_server, path);
-    int res = run_cmd(cmd);
-    if (res != 0) {
-        return res;
+    char path[PATH_MAX];
+    struct stat st;
+    int res = inode_path(ino, path, sizeof(path));
+    if (res == 0) res = get_attr(path, &st);
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
     }
 
-    f = fopen("/tmp/netfs_tempfile", "r+b");
-    if (f == NULL) {
-        return -errno;
+    st.st_ino = ino;
+    fuse_reply_attr(req, &st, attr_timeout);
+}
+
+static void netfs_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set, struct fuse_file_info *fi) {
+    (void) fi;
+
+    char path[PATH_MAX];
+    int res = inode_path(ino, path, sizeof(path));
+    if (res == 0 && (to_set & FUSE_SET_ATTR_SIZE) && whole_files) {
+        res = whole_truncate(path, attr->st_size);
+        meta_invalidate(path);
+    } else if (res == 0 && (to_set & FUSE_SET_ATTR_SIZE)) {
+        res = remote_call(NETFS_TRUNCATE, path, attr->st_size, 0, NULL, NULL, 0);
+        if (res == 0) {
+            cache_truncate(path, attr->st_size);
+            meta_invalidate(path);
+        }
     }
+    // The protocol has no chmod, chown or utimes; the writeback cache's
+    // mtime updates are accepted and the server keeps its own times
 
-    fseek(f, offset, SEEK_SET);
-    res = fwrite(buf, 1, size, f);
-    fclose(f);
+    struct stat st;
+    if (res == 0) res = get_attr(path, &st);
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
 
-    snprintf(cmd, sizeof(cmd), "scp /tmp/netfs_tempfile %s:%s", remote_server, path);
-    res = run_cmd(cmd);
-    if (res != 0) {
-        return res;
+    st.st_ino = ino;
+    fuse_reply_attr(req, &st, attr_timeout);
+}
+
+static void netfs_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    char path[PATH_MAX];
+    int res = inode_path(ino, path, sizeof(path));
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+
+    struct dir_handle *dir = malloc(sizeof(*dir));
+    if (!dir || !(dir->records = list_dir(path, &dir->len))) {
+        res = dir ? errno : ENOMEM;
+        free(dir);
+        fuse_reply_err(req, res);
+        return;
     }
 
-    return res;
+    // Entries come with attributes, so ls -l needs no more round trips
+    for (size_t pos = 0; pos < dir->len; ) {
+        const struct netfs_dirent *dirent = (const struct netfs_dirent *)(dir->records + pos);
+        pos += NETFS_DIRENT_SIZE(dirent->name_len);
+
+        char name[NAME_MAX + 1], child[PATH_MAX];
+        struct stat st;
+        if (dirent->name_len > NAME_MAX) continue;
+        memcpy(name, dirent + 1, dirent->name_len);
+        name[dirent->name_len] = '\0';
+        if (child_path(path, name, child, sizeof(child)) == 0) {
+            remember_attr(child, &dirent->attr, &st);
+        }
+    }
+
+    fi->fh = (uintptr_t)dir;
+    fuse_reply_open(req, fi);
 }
 
-static struct fuse_operations netfs_oper = {
-    .getattr    = netfs_getattr,
-    .read       = netfs_read,
-    .write      = netfs_write,
+// Add one entry to a readdir reply if it fits
+static int add_entry(fuse_req_t req, char *buf, size_t size, size_t *used, const char *name,
+                     const struct stat *st, off_t next) {
+    size_t entry = fuse_add_direntry(req, buf + *used, size - *used, name, st, next);
+    if (entry > size - *used) return 0;
+    *used += entry;
+    return 1;
+}
+
+// "." and ".." are at offsets 1 and 2, entry n of the listing is at n + 3
+static void netfs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info *fi) {
+    (void) ino;
+
+    struct dir_handle *dir = (struct dir_handle *)(uintptr_t)fi->fh;
+    char *buf = malloc(size);
+    if (!buf) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    size_t used = 0;
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    st.st_mode = S_IFDIR;
+    int room = (offset >= 1 || add_entry(req, buf, size, &used, ".", &st, 1)) &&
+               (offset >= 2 || add_entry(req, buf, size, &used, "..", &st, 2));
+
+    off_t next = 3;
+    for (size_t pos = 0; room && pos < dir->len; next++) {
+        const struct netfs_dirent *dirent = (const struct netfs_dirent *)(dir->records + pos);
+        pos += NETFS_DIRENT_SIZE(dirent->name_len);
+        if (next <= offset || dirent->name_len > NAME_MAX) continue;
+
+        char name[NAME_MAX + 1];
+        memcpy(name, dirent + 1, dirent->name_len);
+        name[dirent->name_len] = '\0';
+        attr_to_stat(&dirent->attr, &st);
+        room = add_entry(req, buf, size, &used, name, &st, next);
+    }
+
+    fuse_reply_buf(req, buf, used);
+    free(buf);
+}
+
+static void netfs_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) ino;
+
+    struct dir_handle *dir = (struct dir_handle *)(uintptr_t)fi->fh;
+    free(dir->records);
+    free(dir);
+    fuse_reply_err(req, 0);
+}
+
+// Close-to-open consistency: every open asks the server for the current
+// attributes, whatever the attribute cache holds
+static void open_whole(fuse_req_t req, const char *path, struct fuse_file_info *fi) {
+    struct netfs_attr attr;
+    int res = remote_call(NETFS_STAT, path, 0, 0, NULL, &attr, sizeof(attr));
+    struct whole_file *file;
+    int unchanged;
+    if (res == 0) res = whole_open(path, &attr, (fi->flags & O_TRUNC) != 0, &file, &unchanged);
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+
+    struct stat st;
+    remember_attr(path, &attr, &st);
+    fi->fh = (uintptr_t)file;
+    fi->keep_cache = unchanged;
+    fuse_reply_open(req, fi);
+}
+
+static void netfs_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    char path[PATH_MAX];
+    int res = inode_path(ino, path, sizeof(path));
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+    if (whole_files) {
+        open_whole(req, path, fi);
+        return;
+    }
+
+    struct cache_handle *h = cache_open(path);
+    if (!h) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    fi->fh = (uintptr_t)h;
+    fuse_reply_open(req, fi);
+}
+
+static void netfs_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, struct fuse_file_info *fi) {
+    char dir[PATH_MAX], path[PATH_MAX];
+    int res = inode_path(parent, dir, sizeof(dir));
+    if (res == 0) res = child_path(dir, name, path, sizeof(path));
+
+    struct netfs_attr attr;
+    if (res == 0) res = remote_call(NETFS_CREATE, path, mode, 0, NULL, &attr, sizeof(attr));
+    void *h = NULL;
+    int unchanged;
+    if (res == 0 && whole_files) {
+        res = whole_open(path, &attr, 1, (struct whole_file **)&h, &unchanged);
+    } else if (res == 0 && !(h = cache_open(path))) {
+        res = -ENOMEM;
+    }
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+
+    struct stat st;
+    remember_attr(path, &attr, &st);
+    meta_invalidate_parent(path);
+
+    struct fuse_entry_param entry;
+    fill_entry(path, &st, &entry);
+    fi->fh = (uintptr_t)h;
+    fuse_reply_create(req, &entry, fi);
+}
+
+static void netfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info *fi) {
+    (void) ino;
+
+    if (whole_files) {
+        struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(0);
+        bufv.buf[0].size = whole_read_span(whole_of(fi), size, offset, &bufv.buf[0].fd);
+        bufv.buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+        bufv.buf[0].pos = offset;
+        fuse_reply_data(req, &bufv, FUSE_BUF_SPLICE_MOVE);
+        return;
+    }
+
+    struct cache_span spans[CACHE_MAX_SPANS];
+    int count;
+    int res = cache_read_spans(handle_of(fi), size, offset, spans, CACHE_MAX_SPANS, &count);
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+
+    // Point the reply at the block file so libfuse can splice it to the kernel
+    struct fuse_bufvec *bufv = calloc(1, sizeof(*bufv) + CACHE_MAX_SPANS * sizeof(struct fuse_buf));
+    if (!bufv) {
+        cache_unpin_spans(spans, count);
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    bufv->count = count;
+    for (int i = 0; i < count; i++) {
+        bufv->buf[i].size = spans[i].len;
+        bufv->buf[i].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+        bufv->buf[i].fd = spans[i].fd;
+        bufv->buf[i].pos = spans[i].pos;
+    }
+
+    fuse_reply_data(req, bufv, FUSE_BUF_SPLICE_MOVE);
+    cache_unpin_spans(spans, count);
+    free(bufv);
+}
+
+static void netfs_write(fuse_req_t req, fuse_ino_t ino, const char *buf, size_t size, off_t offset,
+                        struct fuse_file_info *fi) {
+    int res = whole_files ? whole_write(whole_of(fi), buf, size, offset)
+                          : cache_write(handle_of(fi), buf, size, offset);
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+        return;
+    }
+
+    // The cached size may be out of date now
+    char path[PATH_MAX];
+    if (inode_path(ino, path, sizeof(path)) == 0) {
+        meta_invalidate(path);
+    }
+    fuse_reply_write(req, res);
+}
+
+// Called on every close(). Whole files are uploaded here so the close
+// returns only once the next open elsewhere will see the data.
+static void netfs_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) ino;
+
+    fuse_reply_err(req, whole_files ? -whole_flush(whole_of(fi)) : 0);
+}
+
+static void netfs_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi) {
+    (void) ino;
+    (void) datasync;
+
+    fuse_reply_err(req, whole_files ? -whole_flush(whole_of(fi)) : -cache_flush(handle_of(fi), 1));
+}
+
+static void netfs_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) ino;
+
+    if (whole_files) {
+        fuse_reply_err(req, -whole_release(whole_of(fi)));
+        return;
+    }
+
+    // Written blocks go back in the background; fsync is what waits for them
+    if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+        cache_flush(handle_of(fi), 0);
+    }
+    cache_close(handle_of(fi));
+    fuse_reply_err(req, 0);
+}
+
+static const struct fuse_lowlevel_ops netfs_oper = {
+    .init           = netfs_init,
+    .destroy        = netfs_destroy,
+    .lookup         = netfs_lookup,
+    .forget         = netfs_forget,
+    .forget_multi   = netfs_forget_multi,
+    .getattr        = netfs_getattr,
+    .setattr        = netfs_setattr,
+    .opendir        = netfs_opendir,
+    .readdir        = netfs_readdir,
+    .releasedir     = netfs_releasedir,
+    .open           = netfs_open,
+    .create         = netfs_create,
+    .read           = netfs_read,
+    .write          = netfs_write,
+    .flush          = netfs_flush,
+    .fsync          = netfs_fsync,
+    .release        = netfs_release,
 };
 
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-c cache-dir] [-C cache-MiB] [-t attr-ttl] [-n connections] [-w] <host:port | socket-path> <mountpoint> [FUSE options]\n", name);
+    exit(1);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <server> <mountpoint>\n", argv[0]);
+    const char *cache_dir = "/tmp/netfs-cache";
+    size_t cache_size = 256;
+    int connections = 4;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "+c:C:t:n:w")) != -1) {
+        switch (opt) {
+        case 'c':
+            cache_dir = optarg;
+            break;
+        case 'C':
+            cache_size = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            attr_timeout = strtod(optarg, NULL);
+            break;
+        case 'n':
+            connections = atoi(optarg);
+            break;
+        case 'w':
+            whole_files = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind < 2) {
+        usage(argv[0]);
+    }
+
+    meta_init(attr_timeout);
+    remote_server = argv[optind];
+    if (remote_init(remote_server, connections) != 0) {
+        perror(remote_server);
+        return 1;
+    }
+    if ((whole_files ? whole_init(cache_dir, cache_size << 20) : cache_init(cache_dir, cache_size << 20)) != 0) {
+        perror(cache_dir);
         return 1;
     }
 
-    remote_server = argv[1];
-    argv[1] = argv[0]; 
-    return fuse_main(argc - 1, &argv[1], &netfs_oper, NULL);
+    argv[optind] = argv[0];
+    struct fuse_args args = FUSE_ARGS_INIT(argc - optind, &argv[optind]);
+    struct fuse_cmdline_opts opts;
+    if (fuse_parse_cmdline(&args, &opts) != 0 || !opts.mountpoint) {
+        usage(argv[0]);
+    }
+    // Reads as big as the kernel will send; max_write is set in init
+    fuse_opt_add_arg(&args, "-omax_read=1048576");
+
+    int res = 1;
+    struct fuse_session *se = fuse_session_new(&args, &netfs_oper, sizeof(netfs_oper), NULL);
+    if (se && fuse_set_signal_handlers(se) == 0) {
+        if (fuse_session_mount(se, opts.mountpoint) == 0) {
+            fuse_daemonize(opts.foreground);
+            if (opts.singlethread) {
+                res = fuse_session_loop(se);
+            } else {
+                struct fuse_loop_config config = {
+                    .clone_fd = opts.clone_fd,
+                    .max_idle_threads = opts.max_idle_threads,
+                };
+                res = fuse_session_loop_mt(se, &config);
+            }
+            fuse_session_unmount(se);
+        }
+        fuse_remove_signal_handlers(se);
+    }
+    if (se) {
+        fuse_session_destroy(se);
+    }
+    free(opts.mountpoint);
+    fuse_opt_free_args(&args);
+    return res ? 1 : 0;
 }
@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Workload driver for netfs: runs one test against a directory, normally a
+// netfs mount, and prints "key value" lines for run_netfs_bench.sh to
+// collect. `setup` lays out the files the read tests expect; run it on the
+// server's exported directory, where it is much quicker than through the
+// mount.
+//
+//   seqread [MiB]    read seq.dat front to back in 1 MiB reads
+//   randread [ops]   4 KiB reads at random aligned offsets in seq.dat
+//   meta [files]     stat every file in small/, list the directory, then
+//                    open, read and close every file
+//   write [MiB]      write write.dat in 1 MiB writes, then fsync and close
+
+#define SEQ_FILE "seq.dat"
+#define SEQ_MIB 64
+#define SMALL_DIR "small"
+#define SMALL_FILES 500
+#define SMALL_SIZE 4096
+#define WRITE_FILE "write.dat"
+#define CHUNK (1024 * 1024)
+#define RANDOM_SIZE 4096
+#define RANDOM_OPS 1000
+
+static char path_buf[4096];
+static uint64_t *latencies;     // one per operation, in ns
+static size_t op_count;
+static uint64_t bytes;
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static const char *in(const char *dir, const char *name) {
+    snprintf(path_buf, sizeof(path_buf), "%s/%s", dir, name);
+    return path_buf;
+}
+
+static const char *small_file(const char *dir, int i) {
+    snprintf(path_buf, sizeof(path_buf), "%s/%s/f%05d", dir, SMALL_DIR, i);
+    return path_buf;
+}
+
+static int open_or_die(const char *path, int flags) {
+    int fd = open(path, flags, 0644);
+    if (fd < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+static void write_or_die(int fd, const char *buf, size_t len) {
+    if (write(fd, buf, len) != (ssize_t)len) {
+        perror("write");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void record(uint64_t start) {
+    latencies[op_count++] = now_ns() - start;
+}
+
+static void setup(const char *dir, char *buf) {
+    int fd = open_or_die(in(dir, SEQ_FILE), O_WRONLY | O_CREAT | O_TRUNC);
+    for (int i = 0; i < SEQ_MIB; i++) write_or_die(fd, buf, CHUNK);
+    close(fd);
+
+    if (mkdir(in(dir, SMALL_DIR), 0755) != 0 && errno != EEXIST) {
+        perror(path_buf);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < SMALL_FILES; i++) {
+        fd = open_or_die(small_file(dir, i), O_WRONLY | O_CREAT | O_TRUNC);
+        write_or_die(fd, buf, SMALL_SIZE);
+        close(fd);
+    }
+}
+
+static void seqread(const char *dir, char *buf, long mib) {
+    int fd = open_or_die(in(dir, SEQ_FILE), O_RDONLY);
+    for (long i = 0; i < mib; i++) {
+        uint64_t start = now_ns();
+        ssize_t n = read(fd, buf, CHUNK);
+        if (n < 0) {
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+        record(start);
+        bytes += n;
+        if (n < CHUNK) break;
+    }
+    close(fd);
+}
+
+static void randread(const char *dir, char *buf, long ops) {
+    int fd = open_or_die(in(dir, SEQ_FILE), O_RDONLY);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < RANDOM_SIZE) {
+        fprintf(stderr, "%s: missing or too small; run setup first\n", path_buf);
+        exit(EXIT_FAILURE);
+    }
+
+    // Same offsets every run, so cold and warm passes are comparable
+    unsigned int seed = 380;
+    long blocks = st.st_size / RANDOM_SIZE;
+    for (long i = 0; i < ops; i++) {
+        off_t offset = (off_t)(rand_r(&seed) % blocks) * RANDOM_SIZE;
+        uint64_t start = now_ns();
+        ssize_t n = pread(fd, buf, RANDOM_SIZE, offset);
+        if (n < 0) {
+            perror("pread");
+            exit(EXIT_FAILURE);
+        }
+        record(start);
+        bytes += n;
+    }
+    close(fd);
+}
+
+static void meta(const char *dir, char *buf, long files) {
+    struct stat st;
+    for (long i = 0; i < files; i++) {
+        uint64_t start = now_ns();
+        if (stat(small_file(dir, i), &st) != 0) {
+            perror(path_buf);
+            exit(EXIT_FAILURE);
+        }
+        record(start);
+    }
+
+    uint64_t start = now_ns();
+    DIR *d = opendir(in(dir, SMALL_DIR));
+    if (!d) {
+        perror(path_buf);
+        exit(EXIT_FAILURE);
+    }
+    while (readdir(d)) {
+    }
+    closedir(d);
+    record(start);
+
+    for (long i = 0; i < files; i++) {
+        start = now_ns();
+        int fd = open_or_die(small_file(dir, i), O_RDONLY);
+        ssize_t n = read(fd, buf, SMALL_SIZE);
+        if (n < 0) {
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+        record(start);
+        bytes += n;
+    }
+}
+
+static void write_test(const char *dir, char *buf, long mib, uint64_t *sync_ns) {
+    int fd = open_or_die(in(dir, WRITE_FILE), O_WRONLY | O_CREAT | O_TRUNC);
+    for (long i = 0; i < mib; i++) {
+        uint64_t start = now_ns();
+        write_or_die(fd, buf, CHUNK);
+        record(start);
+        bytes += CHUNK;
+    }
+
+    // Write-back caches only reach the server here, so it counts
+    uint64_t start = now_ns();
+    if (fsync(fd) != 0) {
+        perror("fsync");
+        exit(EXIT_FAILURE);
+    }
+    if (close(fd) != 0) {
+        perror("close");
+        exit(EXIT_FAILURE);
+    }
+    *sync_ns = now_ns() - start;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const uint64_t *sorted, size_t n, double p) {
+    size_t i = (size_t)(p / 100 * n);
+    return sorted[i < n ? i : n - 1] / 1e3;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "Usage: %s <dir> <setup | seqread [MiB] | randread [ops] | meta [files] | write [MiB]>\n",
+                argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    const char *dir = argv[1], *test = argv[2];
+    long count = argc > 3 ? atol(argv[3]) : 0;
+
+    char *buf = malloc(CHUNK);
+    if (!buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < CHUNK; i++) buf[i] = i * 7 + 1;
+
+    if (strcmp(test, "setup") == 0) {
+        setup(dir, buf);
+        return 0;
+    }
+
+    if (strcmp(test, "seqread") == 0 || strcmp(test, "write") == 0) {
+        if (count <= 0) count = SEQ_MIB;
+    } else if (strcmp(test, "randread") == 0) {
+        if (count <= 0) count = RANDOM_OPS;
+    } else if (strcmp(test, "meta") == 0) {
+        if (count <= 0 || count > SMALL_FILES) count = SMALL_FILES;
+    } else {
+        fprintf(stderr, "%s: unknown test %s\n", argv[0], test);
+        exit(EXIT_FAILURE);
+    }
+    // meta does two operations per file plus the listing
+    latencies = malloc((2 * count + 1) * sizeof(uint64_t));
+
+    uint64_t sync_ns = 0;
+    uint64_t start = now_ns();
+    switch (test[0]) {
+    case 's': seqread(dir, buf, count); break;
+    case 'r': randread(dir, buf, count); break;
+    case 'm': meta(dir, buf, count); break;
+    case 'w': write_test(dir, buf, count, &sync_ns); break;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    qsort(latencies, op_count, sizeof(uint64_t), compare_u64);
+    double mean = 0;
+    for (size_t i = 0; i < op_count; i++) mean += latencies[i];
+
+    printf("test %s\n", test);
+    printf("ops %zu\n", op_count);
+    printf("bytes %lu\n", bytes);
+    printf("wall_ns %lu\n", elapsed);
+    printf("mib_per_s %.2f\n", bytes / 1048576.0 / (elapsed / 1e9));
+    printf("ops_per_s %.1f\n", op_count / (elapsed / 1e9));
+    printf("mean_us %.1f\n", op_count ? mean / op_count / 1e3 : 0);
+    if (op_count) {
+        printf("p50_us %.1f\n", percentile(latencies, op_count, 50));
+        printf("p99_us %.1f\n", percentile(latencies, op_count, 99));
+        printf("max_us %.1f\n", latencies[op_count - 1] / 1e3);
+    }
+    printf("sync_ns %lu\n", sync_ns);
+    return 0;
+}
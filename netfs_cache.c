@@ -0,0 +1,634 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "netfs_client.h"
+#include "netfs_cache.h"
+
+#define FILE_BUCKETS 1024
+
+struct cached_file {
+    char *path;
+    struct cached_file *next;   // hash chain
+    int attr_known;             // remote_size and mtime are current
+    uint64_t remote_size;
+    int64_t mtime_sec, mtime_nsec;
+    uint64_t local_size;        // size as grown by writes (or set by truncate) through the cache
+    int dirty_blocks;
+    int write_error;            // first failed write-back since the last fsync
+};
+
+// The cache lock protects everything but slot contents. A slot's contents
+// belong to whoever set `fetching` or `flushing`, or are shared read-only
+// by `pins`; a busy block is never evicted or freed.
+struct cache_block {
+    struct cached_file *file;   // NULL while the slot is free
+    uint64_t index;             // block number within the file
+    uint32_t length;            // valid bytes; short for the last block
+    int dirty;
+    uint32_t dirty_lo, dirty_hi;
+    int fetching;               // being filled from the server
+    int flushing;               // dirty range being written back
+    int pins;                   // threads copying to or from the slot
+    struct cache_block *hash_next;
+    struct cache_block *lru_prev, *lru_next;
+};
+
+// Per-open state, kept in fi->fh
+struct cache_handle {
+    struct cached_file *file;
+    off_t next_offset;          // where a sequential read would continue
+    int window;                 // readahead window, in blocks
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t block_cond = PTHREAD_COND_INITIALIZER;   // some block stopped being busy
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+static int flush_requested;
+
+static int cache_fd = -1;               // block file: slot i is at i * CACHE_BLOCK_SIZE
+static struct cache_block *blocks;      // one per slot
+static size_t slot_count;
+static struct cache_block **block_buckets;
+static size_t bucket_mask;
+static struct cached_file *file_buckets[FILE_BUCKETS];
+static struct cache_block lru;          // list head: lru.lru_next is the most recent
+static char *zero_block;
+
+static struct cache_stats stats;
+
+static off_t slot_offset(const struct cache_block *b) {
+    return (off_t)(b - blocks) * CACHE_BLOCK_SIZE;
+}
+
+static int busy(const struct cache_block *b) {
+    return b->fetching || b->flushing || b->pins;
+}
+
+static struct cached_file *lookup_file(const char *path) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char *p = path; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 0x100000001b3ULL;
+    }
+    struct cached_file **bucket = &file_buckets[hash % FILE_BUCKETS];
+    for (struct cached_file *file = *bucket; file; file = file->next) {
+        if (strcmp(file->path, path) == 0) return file;
+    }
+
+    struct cached_file *file = calloc(1, sizeof(*file));
+    file->path = strdup(path);
+    file->next = *bucket;
+    *bucket = file;
+    return file;
+}
+
+static struct cache_block **block_bucket(const struct cached_file *file, uint64_t index) {
+    uint64_t hash = ((uintptr_t)file >> 4) * 0x9e3779b97f4a7c15ULL ^ index * 0xff51afd7ed558ccdULL;
+    return &block_buckets[(hash >> 17) & bucket_mask];
+}
+
+static struct cache_block *find_block(const struct cached_file *file, uint64_t index) {
+    for (struct cache_block *b = *block_bucket(file, index); b; b = b->hash_next) {
+        if (b->file == file && b->index == index) return b;
+    }
+    return NULL;
+}
+
+static void unhash_block(struct cache_block *b) {
+    struct cache_block **p = block_bucket(b->file, b->index);
+    while (*p != b) p = &(*p)->hash_next;
+    *p = b->hash_next;
+    b->file = NULL;
+}
+
+static void lru_unlink(struct cache_block *b) {
+    b->lru_prev->lru_next = b->lru_next;
+    b->lru_next->lru_prev = b->lru_prev;
+}
+
+static void lru_push_front(struct cache_block *b) {
+    b->lru_next = lru.lru_next;
+    b->lru_prev = &lru;
+    lru.lru_next->lru_prev = b;
+    lru.lru_next = b;
+}
+
+static void lru_touch(struct cache_block *b) {
+    lru_unlink(b);
+    lru_push_front(b);
+}
+
+// Forget a block and make its slot the next one alloc_block hands out
+static void free_block(struct cache_block *b) {
+    unhash_block(b);
+    lru_unlink(b);
+    b->lru_prev = lru.lru_prev;
+    b->lru_next = &lru;
+    lru.lru_prev->lru_next = b;
+    lru.lru_prev = b;
+}
+
+// Wait until nobody is using the block. Returns 0 if it was freed or
+// reused for something else meanwhile.
+static int wait_idle(struct cache_block *b, const struct cached_file *file, uint64_t index) {
+    while (b->file == file && b->index == index && busy(b)) {
+        pthread_cond_wait(&block_cond, &cache_lock);
+    }
+    return b->file == file && b->index == index;
+}
+
+static void unpin(struct cache_block *b) {
+    if (--b->pins == 0) pthread_cond_broadcast(&block_cond);
+}
+
+// Send a dirty block's modified range to the server, with the cache lock
+// dropped meanwhile. Failures are kept for the next fsync to report.
+static void flush_block(struct cache_block *b) {
+    struct cached_file *file = b->file;
+    uint64_t index = b->index;
+    uint32_t lo = b->dirty_lo, len = b->dirty_hi - b->dirty_lo;
+    b->dirty = 0;
+    b->flushing = 1;
+    file->dirty_blocks--;
+    pthread_mutex_unlock(&cache_lock);
+
+    int res = -EIO;
+    char *buf = malloc(len);
+    if (buf && pread(cache_fd, buf, len, slot_offset(b) + lo) == len) {
+        res = remote_call(NETFS_WRITE, file->path, index * CACHE_BLOCK_SIZE + lo, len, buf, NULL, 0);
+        if (res >= 0 && res != len) res = -EIO;
+    }
+    free(buf);
+
+    pthread_mutex_lock(&cache_lock);
+    b->flushing = 0;
+    pthread_cond_broadcast(&block_cond);
+    if (res < 0 && !file->write_error) file->write_error = res;
+    stats.writebacks++;
+    stats.writeback_bytes += len;
+    // The write changed the remote mtime; don't mistake that for someone else's change
+    file->attr_known = 0;
+}
+
+// Write back the dirty blocks of `file`, or of every file when it's NULL.
+// Write-backs already in flight are waited for, so everything dirty when
+// this was called is on the server when it returns.
+static void flush_dirty(struct cached_file *file) {
+    for (size_t i = 0; i < slot_count; i++) {
+        struct cache_block *b = &blocks[i];
+        while (b->file && (!file || b->file == file) && b->flushing) {
+            pthread_cond_wait(&block_cond, &cache_lock);
+        }
+        if (b->file && (!file || b->file == file) && b->dirty) flush_block(b);
+    }
+}
+
+// Take the least recently used idle slot for (file, index). The new block
+// is empty and reads as zeros. Dirty victims are written back first, unless
+// `may_wait` is 0, when only a slot that is free right away will do.
+// Returns NULL when there is none, or when the lock had to be dropped and
+// someone else cached the block meanwhile.
+static struct cache_block *alloc_block(struct cached_file *file, uint64_t index, int may_wait) {
+    for (;;) {
+        struct cache_block *b = lru.lru_prev;
+        while (b != &lru && b->file && (busy(b) || (!may_wait && b->dirty))) b = b->lru_prev;
+
+        if (b != &lru && !(b->file && b->dirty)) {
+            if (b->file) {
+                unhash_block(b);
+                stats.evictions++;
+            }
+            if (fallocate(cache_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, slot_offset(b), CACHE_BLOCK_SIZE) != 0 &&
+                pwrite(cache_fd, zero_block, CACHE_BLOCK_SIZE, slot_offset(b)) != CACHE_BLOCK_SIZE) {
+                perror("netfs cache");
+            }
+
+            b->file = file;
+            b->index = index;
+            b->length = 0;
+            b->dirty = 0;
+            struct cache_block **bucket = block_bucket(file, index);
+            b->hash_next = *bucket;
+            *bucket = b;
+            lru_touch(b);
+            return b;
+        }
+
+        if (!may_wait) return NULL;
+        if (b == &lru) {
+            pthread_cond_wait(&block_cond, &cache_lock);
+        } else {
+            flush_block(b);
+        }
+        if (find_block(file, index)) return NULL;
+    }
+}
+
+// Fetch block `index` and up to `count` - 1 blocks after it in one request,
+// with the cache lock dropped meanwhile. Readahead stops at a block that is
+// already cached (it may hold unflushed writes) or when no slot is free
+// without waiting. Returns 0 or -errno; the caller looks the block up again.
+static int fetch_blocks(struct cached_file *file, uint64_t index, int count) {
+    struct cache_block *range[CACHE_MAX_READAHEAD];
+    if (count > CACHE_MAX_READAHEAD) count = CACHE_MAX_READAHEAD;
+    if (!(range[0] = alloc_block(file, index, 1))) return 0;
+    range[0]->fetching = 1;
+
+    int n = 1;
+    while (n < count && !find_block(file, index + n) && (range[n] = alloc_block(file, index + n, 0))) {
+        range[n++]->fetching = 1;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    size_t size = (size_t)n * CACHE_BLOCK_SIZE;
+    char *buf = malloc(size);
+    int got = buf ? remote_call(NETFS_READ, file->path, index * CACHE_BLOCK_SIZE, size, NULL, buf, size) : -ENOMEM;
+    int res = got < 0 ? got : 0;
+    for (int i = 0; i < n && got > 0 && res == 0; i++) {
+        size_t start = (size_t)i * CACHE_BLOCK_SIZE;
+        if (got <= start) break;
+        size_t len = got - start > CACHE_BLOCK_SIZE ? CACHE_BLOCK_SIZE : got - start;
+        if (pwrite(cache_fd, buf + start, len, slot_offset(range[i])) != len) res = -EIO;
+    }
+    free(buf);
+
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < n; i++) {
+        struct cache_block *b = range[i];
+        size_t start = (size_t)i * CACHE_BLOCK_SIZE;
+        b->fetching = 0;
+        // The requested block is kept even past EOF, so the caller finds
+        // it; blocks read ahead only if they have data
+        if (res < 0 || (i > 0 && got <= start)) {
+            free_block(b);
+            continue;
+        }
+        b->length = got <= start ? 0 : got - start > CACHE_BLOCK_SIZE ? CACHE_BLOCK_SIZE : got - start;
+        if (i > 0) stats.readahead_blocks++;
+    }
+    pthread_cond_broadcast(&block_cond);
+    if (res == 0) {
+        stats.fetches++;
+        stats.fetch_bytes += got;
+    }
+    return res;
+}
+
+// The file's size as far as the cache knows, or 0 if it doesn't
+static uint64_t known_size(const struct cached_file *file) {
+    uint64_t size = file->attr_known ? file->remote_size : 0;
+    return file->local_size > size ? file->local_size : size;
+}
+
+struct cache_handle *cache_open(const char *path) {
+    struct cache_handle *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    h->file = lookup_file(path);
+    h->window = 1;
+    pthread_mutex_unlock(&cache_lock);
+    return h;
+}
+
+void cache_close(struct cache_handle *h) {
+    free(h);
+}
+
+// The bytes of block `b` a read can return: a short block is the end of
+// the file unless writes further on grew it, and then the gap reads as zeros
+static uint32_t readable_length(const struct cached_file *file, const struct cache_block *b) {
+    uint64_t start = b->index * CACHE_BLOCK_SIZE;
+    uint64_t end = known_size(file);
+    if (b->length < CACHE_BLOCK_SIZE && end > start + b->length) {
+        return end - start > CACHE_BLOCK_SIZE ? CACHE_BLOCK_SIZE : end - start;
+    }
+    return b->length;
+}
+
+// Map [offset, offset + size) onto cached blocks. Returns the number of
+// spans, -1 with *missing set when a block isn't cached, or -2 when one is
+// still being fetched. With `commit`, fills in and pins the spans.
+static int walk_spans(struct cached_file *file, size_t size, off_t offset, struct cache_span *spans,
+                      int max_spans, int commit, uint64_t *missing, size_t *bytes) {
+    size_t done = 0;
+    int n = 0;
+    while (done < size && n < max_spans) {
+        off_t pos = offset + done;
+        uint64_t index = pos / CACHE_BLOCK_SIZE;
+        uint32_t block_offset = pos % CACHE_BLOCK_SIZE;
+
+        struct cache_block *b = find_block(file, index);
+        if (!b) {
+            *missing = index;
+            return -1;
+        }
+        if (b->fetching) return -2;
+
+        uint32_t length = readable_length(file, b);
+        if (block_offset >= length) break;
+        size_t len = size - done < length - block_offset ? size - done : length - block_offset;
+        if (commit) {
+            b->pins++;
+            lru_touch(b);
+            spans[n].fd = cache_fd;
+            spans[n].pos = slot_offset(b) + block_offset;
+            spans[n].len = len;
+            spans[n].block = b;
+        }
+        n++;
+        done += len;
+        if (length < CACHE_BLOCK_SIZE) break;
+    }
+    *bytes = done;
+    return n;
+}
+
+int cache_read_spans(struct cache_handle *h, size_t size, off_t offset, struct cache_span *spans,
+                     int max_spans, int *count) {
+    pthread_mutex_lock(&cache_lock);
+    struct cached_file *file = h->file;
+
+    if (offset != 0 && offset == h->next_offset) {
+        if (h->window < CACHE_MAX_READAHEAD) h->window *= 2;
+    } else {
+        h->window = 1;
+    }
+
+    // Fetch until every block is there at once; spans are only pinned then,
+    // so a reader never holds slots while it waits for more
+    int fetched = 0, n;
+    size_t bytes;
+    uint64_t missing;
+    while ((n = walk_spans(file, size, offset, spans, max_spans, 0, &missing, &bytes)) < 0) {
+        if (n == -2) {
+            pthread_cond_wait(&block_cond, &cache_lock);
+            continue;
+        }
+
+        // At least the rest of the request, more if reading sequentially
+        uint64_t needed = (offset + size - 1) / CACHE_BLOCK_SIZE - missing + 1;
+        int res = fetch_blocks(file, missing, needed > h->window ? needed : h->window);
+        if (res < 0) {
+            pthread_mutex_unlock(&cache_lock);
+            return res;
+        }
+        stats.misses++;
+        fetched++;
+    }
+    walk_spans(file, size, offset, spans, max_spans, 1, &missing, &bytes);
+    if (n > fetched) stats.hits += n - fetched;
+    h->next_offset = offset + bytes;
+    *count = n;
+
+    pthread_mutex_unlock(&cache_lock);
+    return bytes;
+}
+
+void cache_unpin_spans(struct cache_span *spans, int count) {
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < count; i++) {
+        unpin(spans[i].block);
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+int cache_read(struct cache_handle *h, char *buf, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        struct cache_span spans[CACHE_MAX_SPANS];
+        int count;
+        int got = cache_read_spans(h, size - done, offset + done, spans, CACHE_MAX_SPANS, &count);
+        if (got < 0) return done > 0 ? done : got;
+
+        int res = 0;
+        for (int i = 0; i < count; i++) {
+            if (pread(spans[i].fd, buf + done, spans[i].len, spans[i].pos) != spans[i].len) {
+                res = -EIO;
+                break;
+            }
+            done += spans[i].len;
+        }
+        cache_unpin_spans(spans, count);
+        if (res < 0) return done > 0 ? done : res;
+        // Short: the end of the file
+        if (count < CACHE_MAX_SPANS) break;
+    }
+    return done;
+}
+
+int cache_write(struct cache_handle *h, const char *buf, size_t size, off_t offset) {
+    pthread_mutex_lock(&cache_lock);
+    struct cached_file *file = h->file;
+
+    size_t done = 0;
+    int res = 0;
+    while (done < size) {
+        off_t pos = offset + done;
+        uint64_t index = pos / CACHE_BLOCK_SIZE;
+        uint32_t block_offset = pos % CACHE_BLOCK_SIZE;
+        uint32_t n = size - done < CACHE_BLOCK_SIZE - block_offset ? size - done : CACHE_BLOCK_SIZE - block_offset;
+
+        struct cache_block *b = find_block(file, index);
+        if (!b) {
+            // Partial writes need the rest of the block, unless it is past EOF
+            int past_eof = file->attr_known && index * CACHE_BLOCK_SIZE >= known_size(file);
+            if (n == CACHE_BLOCK_SIZE || past_eof) {
+                alloc_block(file, index, 1);
+            } else if ((res = fetch_blocks(file, index, 1)) < 0) {
+                break;
+            }
+            continue;
+        }
+        if (b->fetching) {
+            pthread_cond_wait(&block_cond, &cache_lock);
+            continue;
+        }
+        lru_touch(b);
+
+        b->pins++;
+        pthread_mutex_unlock(&cache_lock);
+        ssize_t copied = pwrite(cache_fd, buf + done, n, slot_offset(b) + block_offset);
+        pthread_mutex_lock(&cache_lock);
+        unpin(b);
+        if (copied != n) {
+            res = -EIO;
+            break;
+        }
+
+        if (block_offset + n > b->length) b->length = block_offset + n;
+        if (!b->dirty) {
+            b->dirty = 1;
+            b->dirty_lo = block_offset;
+            b->dirty_hi = block_offset + n;
+            file->dirty_blocks++;
+        } else {
+            // Blocks are whole, so the union of two dirty ranges is still valid data
+            if (block_offset < b->dirty_lo) b->dirty_lo = block_offset;
+            if (block_offset + n > b->dirty_hi) b->dirty_hi = block_offset + n;
+        }
+        done += n;
+    }
+    if (offset + done > file->local_size) file->local_size = offset + done;
+
+    pthread_mutex_unlock(&cache_lock);
+    return done > 0 ? done : res;
+}
+
+int cache_flush(struct cache_handle *h, int wait) {
+    pthread_mutex_lock(&cache_lock);
+    int res = 0;
+    if (wait) {
+        flush_dirty(h->file);
+        res = h->file->write_error;
+        h->file->write_error = 0;
+    } else {
+        flush_requested = 1;
+        pthread_cond_signal(&flush_cond);
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return res;
+}
+
+void cache_update_attr(const char *path, struct stat *st) {
+    pthread_mutex_lock(&cache_lock);
+    struct cached_file *file = lookup_file(path);
+
+    int changed = file->remote_size != st->st_size || file->mtime_sec != st->st_mtim.tv_sec ||
+                  file->mtime_nsec != st->st_mtim.tv_nsec;
+    if (file->attr_known && changed && file->dirty_blocks == 0) {
+        // Changed on the server: everything cached for it is stale
+        for (size_t i = 0; i < slot_count; i++) {
+            struct cache_block *b = &blocks[i];
+            if (b->file == file && wait_idle(b, file, b->index) && !b->dirty) free_block(b);
+        }
+        file->local_size = 0;
+    }
+    file->attr_known = 1;
+    file->remote_size = st->st_size;
+    file->mtime_sec = st->st_mtim.tv_sec;
+    file->mtime_nsec = st->st_mtim.tv_nsec;
+
+    if (S_ISREG(st->st_mode) && file->local_size > st->st_size) st->st_size = file->local_size;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_truncate(const char *path, off_t size) {
+    pthread_mutex_lock(&cache_lock);
+    struct cached_file *file = lookup_file(path);
+
+    for (size_t i = 0; i < slot_count; i++) {
+        struct cache_block *b = &blocks[i];
+        if (b->file != file || !wait_idle(b, file, b->index)) continue;
+
+        uint64_t start = b->index * CACHE_BLOCK_SIZE;
+        uint32_t keep = size <= start ? 0 : size - start >= CACHE_BLOCK_SIZE ? CACHE_BLOCK_SIZE : size - start;
+        if (b->dirty && b->dirty_lo >= keep) {
+            b->dirty = 0;
+            file->dirty_blocks--;
+        } else if (b->dirty && b->dirty_hi > keep) {
+            b->dirty_hi = keep;
+        }
+
+        if (keep == 0) {
+            free_block(b);
+        } else if (keep < b->length) {
+            // The cut-off tail must read as zeros if the file grows again
+            if (fallocate(cache_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, slot_offset(b) + keep,
+                          CACHE_BLOCK_SIZE - keep) != 0 &&
+                pwrite(cache_fd, zero_block, CACHE_BLOCK_SIZE - keep, slot_offset(b) + keep) != CACHE_BLOCK_SIZE - keep) {
+                if (b->dirty) file->dirty_blocks--;
+                free_block(b);
+                continue;
+            }
+            b->length = keep;
+        }
+    }
+
+    // Growing leaves a hole the short last block must read through
+    file->local_size = size;
+    // Truncating changed the mtime
+    file->attr_known = 0;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+static void *flusher(void *arg) {
+    (void) arg;
+
+    pthread_mutex_lock(&cache_lock);
+    for (;;) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += CACHE_FLUSH_INTERVAL;
+        while (!flush_requested && pthread_cond_timedwait(&flush_cond, &cache_lock, &deadline) == 0) {
+        }
+        flush_requested = 0;
+        flush_dirty(NULL);
+    }
+    return NULL;
+}
+
+int cache_init(const char *dir, size_t capacity) {
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return -1;
+
+    // Slots are reused in place, so the file needs room for every one of them
+    slot_count = capacity / CACHE_BLOCK_SIZE;
+    if (slot_count < 2 * CACHE_MAX_READAHEAD) slot_count = 2 * CACHE_MAX_READAHEAD;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/blocks.XXXXXX", dir);
+    cache_fd = mkstemp(path);
+    if (cache_fd < 0) return -1;
+    // Nothing in it outlives the mount
+    unlink(path);
+    if (ftruncate(cache_fd, (off_t)slot_count * CACHE_BLOCK_SIZE) != 0) return -1;
+
+    size_t buckets = 1;
+    while (buckets < 2 * slot_count) buckets *= 2;
+    bucket_mask = buckets - 1;
+    block_buckets = calloc(buckets, sizeof(*block_buckets));
+    blocks = calloc(slot_count, sizeof(*blocks));
+    zero_block = calloc(1, CACHE_BLOCK_SIZE);
+    if (!block_buckets || !blocks || !zero_block) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    lru.lru_next = lru.lru_prev = &lru;
+    for (size_t i = 0; i < slot_count; i++) {
+        lru_push_front(&blocks[i]);
+    }
+    return 0;
+}
+
+void cache_start(void) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, flusher, NULL) != 0) {
+        perror("pthread_create");
+        return;
+    }
+    pthread_detach(thread);
+}
+
+void cache_shutdown(FILE *out) {
+    pthread_mutex_lock(&cache_lock);
+    flush_dirty(NULL);
+
+    fprintf(out, "cache_hits %lu\n", stats.hits);
+    fprintf(out, "cache_misses %lu\n", stats.misses);
+    fprintf(out, "cache_readahead_blocks %lu\n", stats.readahead_blocks);
+    fprintf(out, "cache_evictions %lu\n", stats.evictions);
+    fprintf(out, "cache_fetches %lu\n", stats.fetches);
+    fprintf(out, "cache_fetch_bytes %lu\n", stats.fetch_bytes);
+    fprintf(out, "cache_writebacks %lu\n", stats.writebacks);
+    fprintf(out, "cache_writeback_bytes %lu\n", stats.writeback_bytes);
+    pthread_mutex_unlock(&cache_lock);
+}
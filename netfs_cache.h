@@ -0,0 +1,84 @@
+#ifndef NETFS_CACHE_H
+#define NETFS_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Local block cache for netfs. Remote files are cached in fixed-size blocks
+// stored in one file in the cache directory, indexed in memory and evicted
+// least recently used first. Sequential reads grow a readahead window so
+// one request fetches several blocks. Writes land in the cache and are sent
+// back by a flusher thread every few seconds, on release, or synchronously
+// on fsync. Network I/O happens without the cache lock held, so any number
+// of threads can read and write at once.
+
+#define CACHE_BLOCK_SIZE (128 * 1024)
+#define CACHE_MAX_READAHEAD 16          // blocks per fetch
+#define CACHE_FLUSH_INTERVAL 5          // seconds between write-backs
+#define CACHE_MAX_READ (1024 * 1024)    // largest read netfs asks the kernel for
+#define CACHE_MAX_SPANS (CACHE_MAX_READ / CACHE_BLOCK_SIZE + 1)
+
+struct cache_stats {
+    uint64_t hits;              // blocks found in the cache
+    uint64_t misses;            // blocks that had to be fetched
+    uint64_t readahead_blocks;  // fetched ahead of a miss
+    uint64_t evictions;
+    uint64_t fetches;           // READ requests sent
+    uint64_t fetch_bytes;
+    uint64_t writebacks;        // WRITE requests sent for dirty blocks
+    uint64_t writeback_bytes;
+};
+
+// Create the block file in `dir` holding up to `capacity` bytes. Returns 0,
+// or -1 with errno set.
+int cache_init(const char *dir, size_t capacity);
+
+// Start the flusher thread. Called from the FUSE init callback, since
+// fuse_main forks to daemonize after main has run.
+void cache_start(void);
+
+// Per-open state (readahead tracking), stored in fi->fh
+struct cache_handle;
+
+struct cache_handle *cache_open(const char *path);
+void cache_close(struct cache_handle *h);
+
+// Read or write through the cache. Return bytes transferred or -errno.
+int cache_read(struct cache_handle *h, char *buf, size_t size, off_t offset);
+int cache_write(struct cache_handle *h, const char *buf, size_t size, off_t offset);
+
+// Where a read's data lives in the block file, for splicing it out
+// without copying
+struct cache_span {
+    int fd;
+    off_t pos;
+    size_t len;
+    struct cache_block *block;
+};
+
+// Like cache_read, but pin the blocks and describe where their data is
+// instead of copying it. Fills at most `max_spans` spans and sets `count`;
+// returns the bytes they cover (short only at EOF or when the spans run
+// out) or -errno. The spans stay valid until cache_unpin_spans.
+int cache_read_spans(struct cache_handle *h, size_t size, off_t offset, struct cache_span *spans,
+                     int max_spans, int *count);
+void cache_unpin_spans(struct cache_span *spans, int count);
+
+// Write back the file's dirty blocks. With `wait`, do it now and return the
+// first write-back error since the last flush; otherwise just wake the
+// flusher.
+int cache_flush(struct cache_handle *h, int wait);
+
+// Reconcile fresh remote attributes with the cache: drop blocks of a file
+// that changed remotely, and report the size unflushed writes have grown it to
+void cache_update_attr(const char *path, struct stat *st);
+
+// The file was truncated to `size` on the server: drop cached data past it
+void cache_truncate(const char *path, off_t size);
+
+// Flush everything and print the counters, one "name value" per line
+void cache_shutdown(FILE *out);
+
+#endif
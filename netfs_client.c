@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "netfs_client.h"
+
+// A caller waiting for its reply
+struct pending {
+    uint32_t tag;
+    void *buf;
+    size_t len;
+    int status;
+    int done;
+    int failed;             // the connection dropped before the reply came
+    struct pending *next;
+};
+
+struct connection {
+    pthread_mutex_t lock;       // fd and the pending list
+    pthread_cond_t replied;
+    pthread_mutex_t send_lock;  // keeps requests whole on the wire
+    int fd;                     // -1 until (re)connected
+    unsigned closes;            // sockets closed so far; changes under both locks
+    struct pending *pending;
+    int in_flight;
+};
+
+struct reader_args {
+    struct connection *conn;
+    int fd;
+};
+
+static const char *remote_server = NULL;
+static struct connection pool[POOL_MAX];
+static int pool_size = 1;
+static uint32_t next_tag = 0;
+
+int remote_init(const char *address, int connections) {
+    remote_server = address;
+    pool_size = connections < 1 ? 1 : connections > POOL_MAX ? POOL_MAX : connections;
+    for (int i = 0; i < pool_size; i++) {
+        pthread_mutex_init(&pool[i].lock, NULL);
+        pthread_cond_init(&pool[i].replied, NULL);
+        pthread_mutex_init(&pool[i].send_lock, NULL);
+        pool[i].fd = -1;
+    }
+
+    int fd = netfs_connect(remote_server);
+    if (fd < 0) return -1;
+    close(fd);
+    return 0;
+}
+
+// Take the pending request for `tag` off the list
+static struct pending *claim(struct connection *conn, uint32_t tag) {
+    for (struct pending **p = &conn->pending; *p; p = &(*p)->next) {
+        if ((*p)->tag == tag) {
+            struct pending *found = *p;
+            *p = found->next;
+            return found;
+        }
+    }
+    return NULL;
+}
+
+// Deliver replies on one connection until it fails, then fail everything
+// still waiting on it
+static void *reader(void *arg) {
+    struct reader_args args = *(struct reader_args *)arg;
+    struct connection *conn = args.conn;
+    free(arg);
+
+    struct netfs_reply reply;
+    while (read_full(args.fd, &reply, sizeof(reply)) == 0) {
+        pthread_mutex_lock(&conn->lock);
+        struct pending *p = claim(conn, reply.tag);
+        pthread_mutex_unlock(&conn->lock);
+        if (!p || reply.size > p->len) {
+            fprintf(stderr, "netfs: unexpected reply, dropping connection\n");
+            if (p) {
+                pthread_mutex_lock(&conn->lock);
+                p->next = conn->pending;
+                conn->pending = p;
+                pthread_mutex_unlock(&conn->lock);
+            }
+            break;
+        }
+
+        // Only this thread touches p->buf until p->done is set
+        int ok = reply.size == 0 || read_full(args.fd, p->buf, reply.size) == 0;
+        pthread_mutex_lock(&conn->lock);
+        p->status = ok ? reply.status : -EIO;
+        p->failed = !ok;
+        p->done = 1;
+        pthread_cond_broadcast(&conn->replied);
+        pthread_mutex_unlock(&conn->lock);
+        if (!ok) break;
+    }
+
+    // Wake any sender blocked on the socket, then wait out the one holding
+    // send_lock before closing: a sender that still has the number must not
+    // write into whatever reuses it
+    shutdown(args.fd, SHUT_RDWR);
+    pthread_mutex_lock(&conn->send_lock);
+    pthread_mutex_lock(&conn->lock);
+    if (conn->fd == args.fd) conn->fd = -1;
+    close(args.fd);
+    conn->closes++;
+    pthread_mutex_unlock(&conn->send_lock);
+    for (struct pending *p = conn->pending; p; p = p->next) {
+        p->status = -EIO;
+        p->failed = 1;
+        p->done = 1;
+    }
+    conn->pending = NULL;
+    pthread_cond_broadcast(&conn->replied);
+    pthread_mutex_unlock(&conn->lock);
+    return NULL;
+}
+
+// Called with conn->lock held
+static int open_connection(struct connection *conn) {
+    int fd = netfs_connect(remote_server);
+    if (fd < 0) return -1;
+
+    struct reader_args *args = malloc(sizeof(*args));
+    args->conn = conn;
+    args->fd = fd;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, reader, args) != 0) {
+        free(args);
+        close(fd);
+        return -1;
+    }
+    pthread_detach(thread);
+    conn->fd = fd;
+    return 0;
+}
+
+// The connection with the fewest requests in flight
+static struct connection *pick_connection(void) {
+    struct connection *best = &pool[0];
+    for (int i = 1; i < pool_size; i++) {
+        if (__atomic_load_n(&pool[i].in_flight, __ATOMIC_RELAXED) <
+            __atomic_load_n(&best->in_flight, __ATOMIC_RELAXED)) {
+            best = &pool[i];
+        }
+    }
+    return best;
+}
+
+// Send one request and wait for its reply. Sets *failed when the
+// connection, not the server, is why it didn't work.
+static int exchange(struct netfs_request *req, const char *path, const void *data,
+                    void *reply_buf, size_t reply_len, int *failed) {
+    struct connection *conn = pick_connection();
+    struct pending p = {
+        .tag = __atomic_fetch_add(&next_tag, 1, __ATOMIC_RELAXED),
+        .buf = reply_buf,
+        .len = reply_len,
+    };
+    req->tag = p.tag;
+
+    pthread_mutex_lock(&conn->lock);
+    if (conn->fd < 0 && open_connection(conn) != 0) {
+        pthread_mutex_unlock(&conn->lock);
+        *failed = 1;
+        return -EIO;
+    }
+    int fd = conn->fd;
+    unsigned closes = conn->closes;
+    p.next = conn->pending;
+    conn->pending = &p;
+    conn->in_flight++;
+    pthread_mutex_unlock(&conn->lock);
+
+    // `fd` is still our socket only if the reader hasn't closed it since
+    pthread_mutex_lock(&conn->send_lock);
+    int open = conn->closes == closes;
+    int sent = open && write_full(fd, req, sizeof(*req)) == 0 && write_full(fd, path, req->path_len) == 0 &&
+               (req->op != NETFS_WRITE || write_full(fd, data, req->size) == 0);
+    if (!sent && open) {
+        // A half-sent request poisons the stream; the reader fails everyone on it
+        shutdown(fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&conn->send_lock);
+
+    pthread_mutex_lock(&conn->lock);
+    while (!p.done) {
+        pthread_cond_wait(&conn->replied, &conn->lock);
+    }
+    conn->in_flight--;
+    pthread_mutex_unlock(&conn->lock);
+
+    *failed = p.failed;
+    return p.status;
+}
+
+int remote_call(uint32_t op, const char *path, off_t offset, size_t size, const void *data,
+                void *reply_buf, size_t reply_len) {
+    size_t path_len = strlen(path);
+    if (path_len > NETFS_MAX_PATH) return -ENAMETOOLONG;
+    if (size > NETFS_MAX_IO) size = NETFS_MAX_IO;
+
+    struct netfs_request req = {
+        .magic = NETFS_MAGIC,
+        .op = op,
+        .path_len = path_len,
+        .offset = offset,
+        .size = size,
+    };
+
+    int failed;
+    int res = exchange(&req, path, data, reply_buf, reply_len, &failed);
+    if (failed) {
+        // Every request is idempotent, so retry once on a fresh connection
+        res = exchange(&req, path, data, reply_buf, reply_len, &failed);
+    }
+    return res;
+}
@@ -0,0 +1,28 @@
+#ifndef NETFS_CLIENT_H
+#define NETFS_CLIENT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "netfs_proto.h"
+
+// Client side of the netfs protocol. Requests go out over a pool of
+// persistent connections; each connection has a reader thread that matches
+// replies to waiting callers by tag, so any number of requests can be in
+// flight on one connection and threads never wait for each other's round
+// trips.
+
+#define POOL_MAX 32
+
+// Check that `address` (see netfs_proto.h) is reachable and set the pool
+// size. Connections are opened on first use, which is after fuse_main has
+// forked. Returns 0, or -1 with errno set.
+int remote_init(const char *address, int connections);
+
+// One request/reply round trip. `data` is sent for writes; up to
+// `reply_len` bytes of reply payload land in `reply_buf`. Returns the
+// server's status (-errno, or bytes read/written), or -EIO when the
+// connection fails twice. Safe to call from any number of threads.
+int remote_call(uint32_t op, const char *path, off_t offset, size_t size, const void *data,
+                void *reply_buf, size_t reply_len);
+
+#endif
@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "netfs_meta.h"
+
+#define META_BUCKETS 4096
+
+struct meta_entry {
+    char *path;
+    struct meta_entry *next;    // hash chain
+    uint64_t attr_expires;      // 0 when the attributes aren't cached
+    int negative;               // cached ENOENT
+    struct stat st;
+    uint64_t dir_expires;       // 0 when the listing isn't cached
+    void *records;
+    size_t records_len;
+};
+
+static pthread_mutex_t meta_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct meta_entry *buckets[META_BUCKETS];
+static size_t entry_count;
+static uint64_t ttl_ns;
+static struct meta_stats stats;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct meta_entry **bucket_of(const char *path) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char *p = path; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 0x100000001b3ULL;
+    }
+    return &buckets[hash % META_BUCKETS];
+}
+
+static struct meta_entry *find_entry(const char *path) {
+    for (struct meta_entry *entry = *bucket_of(path); entry; entry = entry->next) {
+        if (strcmp(entry->path, path) == 0) return entry;
+    }
+    return NULL;
+}
+
+// Past the limit everything is dropped: cheaper than tracking recency for
+// entries that only live a TTL anyway
+static void clear_entries(void) {
+    for (int i = 0; i < META_BUCKETS; i++) {
+        struct meta_entry *entry = buckets[i];
+        while (entry) {
+            struct meta_entry *next = entry->next;
+            free(entry->path);
+            free(entry->records);
+            free(entry);
+            entry = next;
+        }
+        buckets[i] = NULL;
+    }
+    entry_count = 0;
+}
+
+static struct meta_entry *get_entry(const char *path) {
+    struct meta_entry *entry = find_entry(path);
+    if (entry) return entry;
+
+    if (entry_count >= META_MAX_ENTRIES) clear_entries();
+    entry = calloc(1, sizeof(*entry));
+    entry->path = strdup(path);
+    struct meta_entry **bucket = bucket_of(path);
+    entry->next = *bucket;
+    *bucket = entry;
+    entry_count++;
+    return entry;
+}
+
+void meta_init(double ttl) {
+    ttl_ns = ttl * 1e9;
+}
+
+int meta_lookup(const char *path, struct stat *st) {
+    if (!ttl_ns) return 0;
+
+    pthread_mutex_lock(&meta_lock);
+    int res = 0;
+    struct meta_entry *entry = find_entry(path);
+    if (entry && entry->attr_expires > now_ns()) {
+        if (entry->negative) {
+            res = -ENOENT;
+            stats.negative_hits++;
+        } else {
+            *st = entry->st;
+            res = 1;
+            stats.attr_hits++;
+        }
+    } else {
+        stats.attr_misses++;
+    }
+    pthread_mutex_unlock(&meta_lock);
+    return res;
+}
+
+void meta_store(const char *path, const struct stat *st) {
+    if (!ttl_ns) return;
+
+    pthread_mutex_lock(&meta_lock);
+    struct meta_entry *entry = get_entry(path);
+    entry->st = *st;
+    entry->negative = 0;
+    entry->attr_expires = now_ns() + ttl_ns;
+    pthread_mutex_unlock(&meta_lock);
+}
+
+void meta_store_negative(const char *path) {
+    if (!ttl_ns) return;
+
+    pthread_mutex_lock(&meta_lock);
+    struct meta_entry *entry = get_entry(path);
+    entry->negative = 1;
+    entry->attr_expires = now_ns() + ttl_ns;
+    pthread_mutex_unlock(&meta_lock);
+}
+
+void meta_invalidate(const char *path) {
+    pthread_mutex_lock(&meta_lock);
+    struct meta_entry *entry = find_entry(path);
+    if (entry) entry->attr_expires = 0;
+    pthread_mutex_unlock(&meta_lock);
+}
+
+void *meta_lookup_dir(const char *path, size_t *len) {
+    if (!ttl_ns) return NULL;
+
+    pthread_mutex_lock(&meta_lock);
+    void *records = NULL;
+    struct meta_entry *entry = find_entry(path);
+    if (entry && entry->dir_expires > now_ns()) {
+        records = malloc(entry->records_len ? entry->records_len : 1);
+        memcpy(records, entry->records, entry->records_len);
+        *len = entry->records_len;
+        stats.dir_hits++;
+    } else {
+        stats.dir_misses++;
+    }
+    pthread_mutex_unlock(&meta_lock);
+    return records;
+}
+
+void meta_store_dir(const char *path, const void *records, size_t len) {
+    if (!ttl_ns) return;
+
+    pthread_mutex_lock(&meta_lock);
+    struct meta_entry *entry = get_entry(path);
+    free(entry->records);
+    entry->records = malloc(len ? len : 1);
+    memcpy(entry->records, records, len);
+    entry->records_len = len;
+    entry->dir_expires = now_ns() + ttl_ns;
+    pthread_mutex_unlock(&meta_lock);
+}
+
+void meta_invalidate_parent(const char *path) {
+    char parent[4096];
+    const char *slash = strrchr(path, '/');
+    if (!slash || slash - path >= sizeof(parent)) return;
+    if (slash == path) {
+        strcpy(parent, "/");
+    } else {
+        memcpy(parent, path, slash - path);
+        parent[slash - path] = '\0';
+    }
+
+    pthread_mutex_lock(&meta_lock);
+    struct meta_entry *entry = find_entry(parent);
+    if (entry) entry->dir_expires = 0;
+    pthread_mutex_unlock(&meta_lock);
+}
+
+void meta_report(FILE *out) {
+    pthread_mutex_lock(&meta_lock);
+    fprintf(out, "meta_attr_hits %lu\n", stats.attr_hits);
+    fprintf(out, "meta_negative_hits %lu\n", stats.negative_hits);
+    fprintf(out, "meta_attr_misses %lu\n", stats.attr_misses);
+    fprintf(out, "meta_dir_hits %lu\n", stats.dir_hits);
+    fprintf(out, "meta_dir_misses %lu\n", stats.dir_misses);
+    pthread_mutex_unlock(&meta_lock);
+}
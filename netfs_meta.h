@@ -0,0 +1,50 @@
+#ifndef NETFS_META_H
+#define NETFS_META_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+// Attribute and directory caches for netfs. Attributes, "no such file"
+// results and directory listings are kept for a TTL so metadata-heavy
+// workloads (ls -l, builds probing include paths) don't cost a round trip
+// per call. Changes made through this mount invalidate what they touch;
+// changes made elsewhere show up once the TTL runs out.
+
+#define META_MAX_ENTRIES 65536
+
+struct meta_stats {
+    uint64_t attr_hits;
+    uint64_t negative_hits;     // ENOENT answered from the cache
+    uint64_t attr_misses;
+    uint64_t dir_hits;
+    uint64_t dir_misses;
+};
+
+// Entries live for `ttl` seconds; 0 turns the caches off
+void meta_init(double ttl);
+
+// Look up cached attributes. Returns 1 with `st` filled in, -ENOENT for a
+// cached negative entry, or 0 when nothing current is cached.
+int meta_lookup(const char *path, struct stat *st);
+
+void meta_store(const char *path, const struct stat *st);
+void meta_store_negative(const char *path);
+
+// Forget the attributes of `path`
+void meta_invalidate(const char *path);
+
+// Cached READDIR records for directory `path` (see netfs_proto.h). Returns a
+// malloc'd copy and sets `len`, or NULL when nothing current is cached.
+void *meta_lookup_dir(const char *path, size_t *len);
+
+void meta_store_dir(const char *path, const void *records, size_t len);
+
+// Forget the listing of the directory containing `path`
+void meta_invalidate_parent(const char *path);
+
+// Print the counters, one "name value" per line
+void meta_report(FILE *out);
+
+#endif
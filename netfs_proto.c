@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "netfs_proto.h"
+
+int read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int write_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int unix_address(const char *address, struct sockaddr_un *sun) {
+    if (strlen(address) >= sizeof(sun->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, address);
+    return 0;
+}
+
+// Split "host:port" for getaddrinfo; a missing host means any/localhost
+static struct addrinfo *tcp_address(const char *address, int passive) {
+    char host[256];
+    const char *colon = strrchr(address, ':');
+    if (!colon || colon - address >= sizeof(host)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    memcpy(host, address, colon - address);
+    host[colon - address] = '\0';
+
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_flags = passive ? AI_PASSIVE : 0,
+    };
+    struct addrinfo *result;
+    if (getaddrinfo(host[0] ? host : NULL, colon + 1, &hints, &result) != 0) {
+        errno = EHOSTUNREACH;
+        return NULL;
+    }
+    return result;
+}
+
+int netfs_connect(const char *address) {
+    if (strchr(address, '/')) {
+        struct sockaddr_un sun;
+        if (unix_address(address, &sun) != 0) return -1;
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    struct addrinfo *result = tcp_address(address, 0);
+    if (!result) return -1;
+
+    int fd = -1;
+    for (struct addrinfo *ai = result; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (fd >= 0) {
+        // Requests are small and latency-bound
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+int netfs_listen(const char *address) {
+    int fd;
+    if (strchr(address, '/')) {
+        struct sockaddr_un sun;
+        if (unix_address(address, &sun) != 0) return -1;
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        unlink(address);
+        if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else {
+        struct addrinfo *result = tcp_address(address, 1);
+        if (!result) return -1;
+        fd = socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol);
+        if (fd >= 0) {
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, result->ai_addr, result->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(result);
+        if (fd < 0) return -1;
+    }
+
+    if (listen(fd, 64) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void attr_from_stat(struct netfs_attr *attr, const struct stat *st) {
+    memset(attr, 0, sizeof(*attr));
+    attr->mode = st->st_mode;
+    attr->nlink = st->st_nlink;
+    attr->uid = st->st_uid;
+    attr->gid = st->st_gid;
+    attr->size = st->st_size;
+    attr->blocks = st->st_blocks;
+    attr->atime_sec = st->st_atim.tv_sec;
+    attr->atime_nsec = st->st_atim.tv_nsec;
+    attr->mtime_sec = st->st_mtim.tv_sec;
+    attr->mtime_nsec = st->st_mtim.tv_nsec;
+    attr->ctime_sec = st->st_ctim.tv_sec;
+    attr->ctime_nsec = st->st_ctim.tv_nsec;
+}
+
+void attr_to_stat(const struct netfs_attr *attr, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_mode = attr->mode;
+    st->st_nlink = attr->nlink;
+    st->st_uid = attr->uid;
+    st->st_gid = attr->gid;
+    st->st_size = attr->size;
+    st->st_blocks = attr->blocks;
+    st->st_atim.tv_sec = attr->atime_sec;
+    st->st_atim.tv_nsec = attr->atime_nsec;
+    st->st_mtim.tv_sec = attr->mtime_sec;
+    st->st_mtim.tv_nsec = attr->mtime_nsec;
+    st->st_ctim.tv_sec = attr->ctime_sec;
+    st->st_ctim.tv_nsec = attr->ctime_nsec;
+}
@@ -0,0 +1,80 @@
+#ifndef NETFS_PROTO_H
+#define NETFS_PROTO_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+// Wire protocol between netfs and netfs_server. The client keeps one
+// connection open and sends requests; every request gets exactly one reply
+// carrying the request's tag. Integers are in host byte order: both ends are
+// expected to be the same architecture.
+//
+//   request: struct netfs_request, path_len bytes of path, then for
+//            writes `size` bytes of data
+//   reply:   struct netfs_reply, then `size` bytes of payload (file data for
+//            READ, a struct netfs_attr for STAT and CREATE, directory
+//            entries for READDIR)
+//
+// Servers are addressed as "host:port" for TCP or as a Unix socket path
+// (anything containing a '/').
+
+#define NETFS_MAGIC 0x5346544e     // "NTFS"
+#define NETFS_MAX_PATH 4096
+#define NETFS_MAX_IO (16 * 1024 * 1024)
+
+enum netfs_op {
+    NETFS_STAT = 1,     // attributes of `path`
+    NETFS_READ,         // up to `size` bytes of `path` at `offset`
+    NETFS_WRITE,        // the `size` bytes that follow, at `offset`
+    NETFS_READDIR,      // entries of directory `path` from entry number `offset`,
+                        // as many as fit in `size` bytes; status is the count
+    NETFS_CREATE,       // create regular file `path` with mode `offset`
+    NETFS_TRUNCATE,     // set the size of `path` to `offset`
+};
+
+struct netfs_request {
+    uint32_t magic;
+    uint32_t op;
+    uint32_t tag;
+    uint32_t path_len;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct netfs_reply {
+    uint32_t tag;
+    int32_t status;     // -errno on failure; bytes read or written otherwise
+    uint64_t size;      // payload bytes following the reply
+};
+
+struct netfs_attr {
+    uint32_t mode, nlink, uid, gid;
+    uint64_t size, blocks;
+    int64_t atime_sec, atime_nsec;
+    int64_t mtime_sec, mtime_nsec;
+    int64_t ctime_sec, ctime_nsec;
+};
+
+// READDIR payload: one record per entry, "." and ".." excluded, each one a
+// struct netfs_dirent followed by the name and padded to 8 bytes
+struct netfs_dirent {
+    struct netfs_attr attr;
+    uint32_t name_len;
+    uint32_t reserved;
+};
+
+#define NETFS_DIRENT_SIZE(name_len) ((sizeof(struct netfs_dirent) + (name_len) + 7) & ~(size_t)7)
+
+// Read or write exactly `len` bytes. Return 0, or -1 on error or EOF.
+int read_full(int fd, void *buf, size_t len);
+int write_full(int fd, const void *buf, size_t len);
+
+// Connect to or listen on a server address. Return the socket, or -1 with
+// errno set.
+int netfs_connect(const char *address);
+int netfs_listen(const char *address);
+
+void attr_from_stat(struct netfs_attr *attr, const struct stat *st);
+void attr_to_stat(const struct netfs_attr *attr, struct stat *st);
+
+#endif
@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include "netfs_proto.h"
+
+// Stand-in netfs server: exports a local directory over the netfs protocol
+// (see netfs_proto.h). Each connection is served by its own process.
+//
+// -r and -b put an emulated network between the server and its clients:
+// every reply is held back for the round-trip time, and both directions of
+// the link carry at most the given bandwidth. The link is shared by every
+// connection, as a real one would be, so a client's connection pool splits
+// the bandwidth rather than multiplying it.
+
+static const char *root;
+
+static uint64_t rtt_ns;                 // -r
+static double ns_per_byte;              // -b; 0 is unlimited
+
+// When each direction of the link is next idle, in shared memory so that
+// every connection process sees the others' transfers
+struct link {
+    uint64_t up_free_ns;
+    uint64_t down_free_ns;
+};
+static struct link *wire;
+
+// Replies waiting for their time on the link, in the order they go out
+struct delayed {
+    uint64_t due_ns;
+    size_t len;
+    struct delayed *next;
+    char data[];
+};
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond;       // on CLOCK_MONOTONIC
+static struct delayed *queue_head, *queue_tail;
+static int queue_closed;
+
+// Remote paths are absolute within the exported root; ".." can't climb out
+static int local_path(const char *path, char *out, size_t len) {
+    if (path[0] != '/') return -EINVAL;
+    for (const char *p = path; (p = strstr(p, "..")); p += 2) {
+        if (p[-1] == '/' && (p[2] == '/' || p[2] == '\0')) return -EACCES;
+    }
+    if (snprintf(out, len, "%s%s", root, path) >= len) return -ENAMETOOLONG;
+    return 0;
+}
+
+static int do_stat(const char *path, struct netfs_attr *attr) {
+    struct stat st;
+    if (lstat(path, &st) != 0) return -errno;
+    attr_from_stat(attr, &st);
+    return 0;
+}
+
+static int do_read(const char *path, char *buf, size_t size, off_t offset) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -errno;
+
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, buf + done, size - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            int err = errno;
+            close(fd);
+            return -err;
+        }
+        if (n == 0) break;
+        done += n;
+    }
+    close(fd);
+    return done;
+}
+
+static int do_write(const char *path, const char *buf, size_t size, off_t offset) {
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) return -errno;
+
+    ssize_t n = pwrite(fd, buf, size, offset);
+    int err = errno;
+    close(fd);
+    return n < 0 ? -err : n;
+}
+
+// Fill `buf` with the entries of `path` from entry number `first` on
+static int do_readdir(const char *path, char *buf, size_t size, uint64_t first, size_t *used) {
+    DIR *dir = opendir(path);
+    if (!dir) return -errno;
+
+    int count = 0;
+    uint64_t index = 0;
+    *used = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (index++ < first) continue;
+
+        size_t name_len = strlen(entry->d_name);
+        size_t record = NETFS_DIRENT_SIZE(name_len);
+        if (*used + record > size) break;
+
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            // Gone since readdir; the client will find out on lookup
+            memset(&st, 0, sizeof(st));
+        }
+        struct netfs_dirent *dirent = (struct netfs_dirent *)(buf + *used);
+        memset(dirent, 0, record);
+        attr_from_stat(&dirent->attr, &st);
+        dirent->name_len = name_len;
+        memcpy(dirent + 1, entry->d_name, name_len);
+        *used += record;
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+static int do_create(const char *path, mode_t mode, struct netfs_attr *attr) {
+    int fd = open(path, O_WRONLY | O_CREAT, mode);
+    if (fd < 0) return -errno;
+
+    struct stat st;
+    int res = fstat(fd, &st) == 0 ? 0 : -errno;
+    close(fd);
+    if (res == 0) attr_from_stat(attr, &st);
+    return res;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Book `bytes` on one direction of the link, starting no earlier than
+// `start`. Returns when the last byte is through.
+static uint64_t transfer(uint64_t *free_ns, uint64_t start, uint64_t bytes) {
+    uint64_t cost = bytes * ns_per_byte;
+    uint64_t busy = __atomic_load_n(free_ns, __ATOMIC_RELAXED), end;
+    do {
+        end = (busy > start ? busy : start) + cost;
+    } while (!__atomic_compare_exchange_n(free_ns, &busy, end, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return end;
+}
+
+// Send queued replies once they are due. Each connection's replies are
+// booked in arrival order, so due times never go backwards.
+static void *sender(void *arg) {
+    int fd = *(int *)arg;
+    int ok = 1;
+
+    pthread_mutex_lock(&queue_lock);
+    for (;;) {
+        while (!queue_head && !queue_closed) {
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        }
+        struct delayed *d = queue_head;
+        if (!d) break;
+        queue_head = d->next;
+        if (!queue_head) queue_tail = NULL;
+        pthread_mutex_unlock(&queue_lock);
+
+        struct timespec due = { d->due_ns / 1000000000, d->due_ns % 1000000000 };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {
+        }
+        if (ok && write_full(fd, d->data, d->len) != 0) {
+            // Let the request loop see the connection is gone
+            shutdown(fd, SHUT_RDWR);
+            ok = 0;
+        }
+        free(d);
+        pthread_mutex_lock(&queue_lock);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return NULL;
+}
+
+// Send a reply, through the emulated link when there is one. `arrived` is
+// when the request header was read and `request_bytes` its size on the wire.
+static int send_reply(int fd, const struct netfs_reply *reply, const void *payload, uint64_t arrived,
+                      size_t request_bytes) {
+    if (!wire) {
+        return write_full(fd, reply, sizeof(*reply)) != 0 ||
+               (reply->size && write_full(fd, payload, reply->size) != 0) ? -1 : 0;
+    }
+
+    size_t len = sizeof(*reply) + reply->size;
+    struct delayed *d = malloc(sizeof(*d) + len);
+    if (!d) return -1;
+    memcpy(d->data, reply, sizeof(*reply));
+    if (reply->size) memcpy(d->data + sizeof(*reply), payload, reply->size);
+    d->len = len;
+    d->next = NULL;
+
+    // Half the round trip each way, plus queueing behind other transfers
+    uint64_t received = transfer(&wire->up_free_ns, arrived + rtt_ns / 2, request_bytes);
+    d->due_ns = transfer(&wire->down_free_ns, received, len) + rtt_ns / 2;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail) queue_tail->next = d;
+    else queue_head = d;
+    queue_tail = d;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    return 0;
+}
+
+static void serve(int fd) {
+    char *buf = malloc(NETFS_MAX_IO);
+    if (!buf) return;
+
+    pthread_t thread;
+    if (wire) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&queue_cond, &attr);
+        if (pthread_create(&thread, NULL, sender, &fd) != 0) {
+            perror("pthread_create");
+            free(buf);
+            return;
+        }
+    }
+
+    struct netfs_request req;
+    char path[NETFS_MAX_PATH + 1], full[PATH_MAX];
+    while (read_full(fd, &req, sizeof(req)) == 0) {
+        uint64_t arrived = wire ? now_ns() : 0;
+        if (req.magic != NETFS_MAGIC || req.path_len > NETFS_MAX_PATH || req.size > NETFS_MAX_IO) {
+            fprintf(stderr, "netfs_server: bad request, closing connection\n");
+            break;
+        }
+        if (read_full(fd, path, req.path_len) != 0) break;
+        path[req.path_len] = '\0';
+        if (req.op == NETFS_WRITE && read_full(fd, buf, req.size) != 0) break;
+
+        struct netfs_reply reply = { .tag = req.tag };
+        const void *payload = NULL;
+        struct netfs_attr attr;
+
+        reply.status = local_path(path, full, sizeof(full));
+        if (reply.status == 0) {
+            switch (req.op) {
+            case NETFS_STAT:
+                reply.status = do_stat(full, &attr);
+                if (reply.status == 0) {
+                    payload = &attr;
+                    reply.size = sizeof(attr);
+                }
+                break;
+            case NETFS_READ:
+                reply.status = do_read(full, buf, req.size, req.offset);
+                if (reply.status > 0) {
+                    payload = buf;
+                    reply.size = reply.status;
+                }
+                break;
+            case NETFS_WRITE:
+                reply.status = do_write(full, buf, req.size, req.offset);
+                break;
+            case NETFS_READDIR: {
+                size_t used = 0;
+                reply.status = do_readdir(full, buf, req.size, req.offset, &used);
+                if (reply.status > 0) {
+                    payload = buf;
+                    reply.size = used;
+                }
+                break;
+            }
+            case NETFS_CREATE:
+                reply.status = do_create(full, req.offset & 07777, &attr);
+                if (reply.status == 0) {
+                    payload = &attr;
+                    reply.size = sizeof(attr);
+                }
+                break;
+            case NETFS_TRUNCATE:
+                reply.status = truncate(full, req.offset) == 0 ? 0 : -errno;
+                break;
+            default:
+                reply.status = -ENOSYS;
+            }
+        }
+
+        size_t request_bytes = sizeof(req) + req.path_len + (req.op == NETFS_WRITE ? req.size : 0);
+        if (send_reply(fd, &reply, payload, arrived, request_bytes) != 0) {
+            break;
+        }
+    }
+
+    if (wire) {
+        pthread_mutex_lock(&queue_lock);
+        queue_closed = 1;
+        pthread_cond_signal(&queue_cond);
+        pthread_mutex_unlock(&queue_lock);
+        pthread_join(thread, NULL);
+    }
+    free(buf);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-r rtt-ms] [-b bandwidth-MiB/s] <host:port | socket-path> <root-dir>\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    double rtt_ms = 0, bandwidth = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:")) != -1) {
+        switch (opt) {
+        case 'r':
+            rtt_ms = strtod(optarg, NULL);
+            break;
+        case 'b':
+            bandwidth = strtod(optarg, NULL);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2 || rtt_ms < 0 || bandwidth < 0) {
+        usage(argv[0]);
+    }
+    root = argv[optind + 1];
+
+    if (rtt_ms > 0 || bandwidth > 0) {
+        rtt_ns = rtt_ms * 1e6;
+        ns_per_byte = bandwidth > 0 ? 1e9 / (bandwidth * 1024 * 1024) : 0;
+        wire = mmap(NULL, sizeof(*wire), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (wire == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int listen_fd = netfs_listen(argv[optind]);
+    if (listen_fd < 0) {
+        perror(argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Connection processes reap themselves
+    signal(SIGCHLD, SIG_IGN);
+
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            exit(EXIT_FAILURE);
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+        } else if (pid == 0) {
+            close(listen_fd);
+            serve(fd);
+            exit(EXIT_SUCCESS);
+        }
+        close(fd);
+    }
+}
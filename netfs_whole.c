@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "netfs_client.h"
+#include "netfs_whole.h"
+
+#define FILE_BUCKETS 1024
+
+// The whole lock protects every field but the local copy's contents. The
+// io lock serializes fetches and uploads of one file, and is held across
+// their network round trips.
+struct whole_file {
+    char *path;
+    struct whole_file *next;    // hash chain
+    pthread_mutex_t io_lock;
+    unsigned long id;           // names the local copy
+    int fd;                     // local copy; open while the file is, or dirty
+    int opens;
+    int valid;                  // the local copy holds the file as of the stamp
+    int dirty;                  // written since the last upload
+    uint64_t size;              // of the local copy
+    uint64_t remote_size;       // stamp: remote attributes the copy matches
+    int64_t mtime_sec, mtime_nsec;
+    time_t last_used;
+};
+
+static pthread_mutex_t whole_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct whole_file *file_buckets[FILE_BUCKETS];
+static char local_dir[PATH_MAX];
+static size_t local_capacity;
+static unsigned long next_id;
+
+static struct whole_stats stats;
+
+static struct whole_file *find_file(const char *path, int create) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char *p = path; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 0x100000001b3ULL;
+    }
+
+    struct whole_file **bucket = &file_buckets[hash % FILE_BUCKETS];
+    for (struct whole_file *f = *bucket; f; f = f->next) {
+        if (strcmp(f->path, path) == 0) return f;
+    }
+    if (!create) return NULL;
+
+    struct whole_file *f = calloc(1, sizeof(*f));
+    if (!f || !(f->path = strdup(path))) {
+        free(f);
+        return NULL;
+    }
+    pthread_mutex_init(&f->io_lock, NULL);
+    f->id = next_id++;
+    f->fd = -1;
+    f->next = *bucket;
+    *bucket = f;
+    return f;
+}
+
+static void local_path(const struct whole_file *f, char *path, size_t len) {
+    snprintf(path, len, "%s/%lu", local_dir, f->id);
+}
+
+static int same_stamp(const struct whole_file *f, const struct netfs_attr *attr) {
+    return f->remote_size == attr->size && f->mtime_sec == attr->mtime_sec && f->mtime_nsec == attr->mtime_nsec;
+}
+
+static void set_stamp(struct whole_file *f, const struct netfs_attr *attr) {
+    f->remote_size = attr->size;
+    f->mtime_sec = attr->mtime_sec;
+    f->mtime_nsec = attr->mtime_nsec;
+}
+
+// Drop the least recently used closed copies until the rest fit
+static void evict(void) {
+    for (;;) {
+        uint64_t total = 0;
+        struct whole_file *victim = NULL;
+        for (int i = 0; i < FILE_BUCKETS; i++) {
+            for (struct whole_file *f = file_buckets[i]; f; f = f->next) {
+                if (!f->valid && !f->dirty) continue;
+                total += f->size;
+                if (f->opens == 0 && !f->dirty && (!victim || f->last_used < victim->last_used)) victim = f;
+            }
+        }
+        if (total <= local_capacity || !victim) return;
+
+        char path[PATH_MAX + 32];
+        local_path(victim, path, sizeof(path));
+        unlink(path);
+        victim->valid = 0;
+        victim->size = 0;
+        stats.evictions++;
+    }
+}
+
+// Replace the local copy with the remote file as of `attr`. Called with
+// the io lock held.
+static int fetch(struct whole_file *f, const struct netfs_attr *attr) {
+    char *buf = malloc(WHOLE_CHUNK);
+    if (!buf) return -ENOMEM;
+
+    int res = ftruncate(f->fd, 0) == 0 ? 0 : -errno;
+    uint64_t offset = 0;
+    while (res == 0 && offset < attr->size) {
+        int got = remote_call(NETFS_READ, f->path, offset, WHOLE_CHUNK, NULL, buf, WHOLE_CHUNK);
+        if (got <= 0) {
+            res = got;
+            break;
+        }
+        if (pwrite(f->fd, buf, got, offset) != got) res = -EIO;
+        offset += got;
+    }
+    free(buf);
+
+    pthread_mutex_lock(&whole_lock);
+    f->valid = res == 0;
+    f->size = res == 0 ? offset : 0;
+    if (res == 0) {
+        set_stamp(f, attr);
+        stats.fetches++;
+        stats.fetch_bytes += offset;
+    }
+    pthread_mutex_unlock(&whole_lock);
+    return res;
+}
+
+// Send the local copy back if it has unsent writes. Called with the io
+// lock held; writes made meanwhile leave it dirty for the next upload.
+static int upload(struct whole_file *f) {
+    pthread_mutex_lock(&whole_lock);
+    uint64_t size = f->size;
+    int dirty = f->dirty;
+    f->dirty = 0;
+    pthread_mutex_unlock(&whole_lock);
+    if (!dirty) return 0;
+
+    char *buf = malloc(WHOLE_CHUNK);
+    int res = buf ? 0 : -ENOMEM;
+    uint64_t offset = 0;
+    while (res == 0 && offset < size) {
+        size_t len = size - offset < WHOLE_CHUNK ? size - offset : WHOLE_CHUNK;
+        ssize_t got = pread(f->fd, buf, len, offset);
+        if (got <= 0) {
+            // A truncate shrank the copy under us; it is dirty again
+            res = got < 0 ? -EIO : 0;
+            break;
+        }
+        int sent = remote_call(NETFS_WRITE, f->path, offset, got, buf, NULL, 0);
+        if (sent < 0) res = sent;
+        offset += got;
+    }
+    free(buf);
+
+    // Cut off whatever the remote file had past our end
+    struct netfs_attr attr;
+    if (res == 0) res = remote_call(NETFS_TRUNCATE, f->path, offset, 0, NULL, NULL, 0);
+    if (res == 0) res = remote_call(NETFS_STAT, f->path, 0, 0, NULL, &attr, sizeof(attr));
+
+    pthread_mutex_lock(&whole_lock);
+    if (res < 0) {
+        f->dirty = 1;
+    } else {
+        // Our own upload is not a remote change
+        set_stamp(f, &attr);
+        f->valid = 1;
+        stats.uploads++;
+        stats.upload_bytes += offset;
+    }
+    pthread_mutex_unlock(&whole_lock);
+    return res;
+}
+
+// Drop one open; the local copy stays open while it still has to be sent
+static void put_file(struct whole_file *f) {
+    pthread_mutex_lock(&whole_lock);
+    f->last_used = time(NULL);
+    if (--f->opens == 0 && !f->dirty) {
+        close(f->fd);
+        f->fd = -1;
+        evict();
+    }
+    pthread_mutex_unlock(&whole_lock);
+}
+
+int whole_open(const char *path, const struct netfs_attr *attr, int empty, struct whole_file **file,
+               int *unchanged) {
+    pthread_mutex_lock(&whole_lock);
+    struct whole_file *f = find_file(path, 1);
+    if (!f) {
+        pthread_mutex_unlock(&whole_lock);
+        return -ENOMEM;
+    }
+    f->opens++;
+    stats.opens++;
+    pthread_mutex_unlock(&whole_lock);
+
+    pthread_mutex_lock(&f->io_lock);
+    pthread_mutex_lock(&whole_lock);
+    int res = 0;
+    if (f->fd < 0) {
+        char local[PATH_MAX + 32];
+        local_path(f, local, sizeof(local));
+        f->fd = open(local, O_RDWR | O_CREAT, 0600);
+        if (f->fd < 0) res = -errno;
+    }
+    // Unsent writes are newer than anything on the server
+    int current = f->dirty || (f->valid && same_stamp(f, attr));
+    *unchanged = current && !empty;
+    if (res == 0 && empty) {
+        // Created or opened with O_TRUNC: nothing to fetch
+        res = ftruncate(f->fd, 0) == 0 ? 0 : -errno;
+        f->size = 0;
+        f->valid = res == 0;
+        set_stamp(f, attr);
+        if (attr->size != 0) f->dirty = 1;
+    } else if (res == 0 && current) {
+        stats.hits++;
+    }
+    pthread_mutex_unlock(&whole_lock);
+
+    if (res == 0 && !current && !empty) res = fetch(f, attr);
+    pthread_mutex_unlock(&f->io_lock);
+
+    if (res < 0) {
+        put_file(f);
+        return res;
+    }
+
+    pthread_mutex_lock(&whole_lock);
+    evict();
+    pthread_mutex_unlock(&whole_lock);
+    *file = f;
+    return 0;
+}
+
+int whole_flush(struct whole_file *file) {
+    pthread_mutex_lock(&file->io_lock);
+    int res = upload(file);
+    pthread_mutex_unlock(&file->io_lock);
+    return res;
+}
+
+int whole_release(struct whole_file *file) {
+    int res = whole_flush(file);
+    put_file(file);
+    return res;
+}
+
+size_t whole_read_span(struct whole_file *file, size_t size, off_t offset, int *fd) {
+    pthread_mutex_lock(&whole_lock);
+    uint64_t end = file->size;
+    *fd = file->fd;
+    pthread_mutex_unlock(&whole_lock);
+
+    if (offset >= end) return 0;
+    return end - offset < size ? end - offset : size;
+}
+
+int whole_write(struct whole_file *file, const char *buf, size_t size, off_t offset) {
+    ssize_t done = pwrite(file->fd, buf, size, offset);
+    if (done < 0) return -errno;
+
+    pthread_mutex_lock(&whole_lock);
+    file->dirty = 1;
+    if (offset + done > file->size) file->size = offset + done;
+    pthread_mutex_unlock(&whole_lock);
+    return done;
+}
+
+int whole_truncate(const char *path, off_t size) {
+    pthread_mutex_lock(&whole_lock);
+    struct whole_file *f = find_file(path, 0);
+    if (f && (f->opens > 0 || f->dirty)) {
+        int res = ftruncate(f->fd, size) == 0 ? 0 : -errno;
+        if (res == 0) {
+            f->size = size;
+            f->dirty = 1;
+        }
+        pthread_mutex_unlock(&whole_lock);
+        return res;
+    }
+    pthread_mutex_unlock(&whole_lock);
+
+    // The local copy is refetched on the next open, as for any remote change
+    return remote_call(NETFS_TRUNCATE, path, size, 0, NULL, NULL, 0);
+}
+
+void whole_update_attr(const char *path, struct stat *st) {
+    pthread_mutex_lock(&whole_lock);
+    struct whole_file *f = find_file(path, 0);
+    if (f && f->dirty && S_ISREG(st->st_mode)) st->st_size = f->size;
+    pthread_mutex_unlock(&whole_lock);
+}
+
+int whole_init(const char *dir, size_t capacity) {
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return -1;
+
+    snprintf(local_dir, sizeof(local_dir), "%s/whole.XXXXXX", dir);
+    if (!mkdtemp(local_dir)) return -1;
+    local_capacity = capacity;
+    return 0;
+}
+
+void whole_shutdown(FILE *out) {
+    for (int i = 0; i < FILE_BUCKETS; i++) {
+        for (struct whole_file *f = file_buckets[i]; f; f = f->next) {
+            pthread_mutex_lock(&f->io_lock);
+            if (f->dirty && upload(f) < 0) fprintf(stderr, "%s: upload failed, changes lost\n", f->path);
+            pthread_mutex_unlock(&f->io_lock);
+
+            char path[PATH_MAX + 32];
+            local_path(f, path, sizeof(path));
+            unlink(path);
+        }
+    }
+    rmdir(local_dir);
+
+    pthread_mutex_lock(&whole_lock);
+    fprintf(out, "whole_opens %lu\n", stats.opens);
+    fprintf(out, "whole_hits %lu\n", stats.hits);
+    fprintf(out, "whole_fetches %lu\n", stats.fetches);
+    fprintf(out, "whole_fetch_bytes %lu\n", stats.fetch_bytes);
+    fprintf(out, "whole_uploads %lu\n", stats.uploads);
+    fprintf(out, "whole_upload_bytes %lu\n", stats.upload_bytes);
+    fprintf(out, "whole_evictions %lu\n", stats.evictions);
+    pthread_mutex_unlock(&whole_lock);
+}
@@ -0,0 +1,67 @@
+#ifndef NETFS_WHOLE_H
+#define NETFS_WHOLE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "netfs_proto.h"
+
+// Whole-file cache for netfs (-w), in the style of AFS. Opening a file
+// checks its attributes with the server and fetches the entire file into a
+// local copy unless the copy already matches the remote size and mtime.
+// Reads and writes go to the local copy; a file written through the mount
+// is uploaded in one go when it is closed. That gives close-to-open
+// consistency: an open sees everything closed before it anywhere.
+
+#define WHOLE_CHUNK (4 * 1024 * 1024)  // bytes per READ or WRITE request
+
+struct whole_stats {
+    uint64_t opens;
+    uint64_t hits;              // opens served by the local copy as it was
+    uint64_t fetches;           // whole files fetched
+    uint64_t fetch_bytes;
+    uint64_t uploads;           // whole files sent back
+    uint64_t upload_bytes;
+    uint64_t evictions;
+};
+
+// Keep local copies in a new directory under `dir`, evicting closed ones
+// once they take more than `capacity` bytes. Returns 0, or -1 with errno set.
+int whole_init(const char *dir, size_t capacity);
+
+struct whole_file;
+
+// Revalidate and if needed fetch `path`, whose current remote attributes
+// are `attr`; `empty` starts it out empty instead (just created, or opened
+// with O_TRUNC). Sets `file`, and `unchanged` when the local copy was
+// already current so the kernel may keep its page cache. Returns 0 or
+// -errno.
+int whole_open(const char *path, const struct netfs_attr *attr, int empty, struct whole_file **file,
+               int *unchanged);
+
+// Upload the file if it has unsent writes. Returns 0 or -errno.
+int whole_flush(struct whole_file *file);
+
+// Drop one open, uploading first if needed. Returns 0 or -errno.
+int whole_release(struct whole_file *file);
+
+// Where a read's data is in the local copy: sets `fd` and returns the bytes
+// available at `offset`, up to `size`
+size_t whole_read_span(struct whole_file *file, size_t size, off_t offset, int *fd);
+
+// Write to the local copy. Returns bytes written or -errno.
+int whole_write(struct whole_file *file, const char *buf, size_t size, off_t offset);
+
+// Set the size of `path`. A file that is open or has unsent writes is
+// truncated locally and uploaded later; otherwise the server is asked
+// directly. Returns 0 or -errno.
+int whole_truncate(const char *path, off_t size);
+
+// Report the size of unsent writes to an open `path` in `st`
+void whole_update_attr(const char *path, struct stat *st);
+
+// Upload what is dirty, remove the local copies and print the counters
+void whole_shutdown(FILE *out);
+
+#endif
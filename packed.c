@@ -0,0 +1,108 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "packed.h"
+#include "stats.h"
+#include "lz4.h"
+
+// Buffers come from mmap rather than malloc: the loaded program owns the heap
+static void *map_buffer(size_t size) {
+    void *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    return buf;
+}
+
+struct packed_file *packed_open(int fd) {
+    struct packed_header header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != PACKED_MAGIC) {
+        return NULL;
+    }
+
+    if (header.version != PACKED_VERSION || header.cluster_size == 0 || header.cluster_size % PAGE_SIZE ||
+        (uint64_t)header.cluster_count * header.cluster_size < header.file_size) {
+        fprintf(stderr, "Unsupported packed executable.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct packed_file *packed = map_buffer(sizeof(*packed));
+    size_t table_size = header.cluster_count * sizeof(struct packed_cluster);
+    packed->fd = fd;
+    packed->header = header;
+    packed->clusters = map_buffer(table_size);
+    packed->block = map_buffer(header.cluster_size);
+    packed->cluster = map_buffer(header.cluster_size);
+    packed->cached = -1;
+
+    if (pread(fd, packed->clusters, table_size, sizeof(header)) != table_size) {
+        perror("read");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < header.cluster_count; i++) {
+        if (packed->clusters[i].size > header.cluster_size) {
+            fprintf(stderr, "Corrupt packed executable.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return packed;
+}
+
+static int load_cluster(struct packed_file *packed, uint32_t index) {
+    if (packed->cached == index) return 0;
+
+    const struct packed_cluster *cluster = &packed->clusters[index];
+    uint64_t start = (uint64_t)index * packed->header.cluster_size;
+    uint64_t expected = packed->header.file_size - start;
+    if (expected > packed->header.cluster_size) expected = packed->header.cluster_size;
+
+    unsigned char *dst = cluster->flags & PACKED_RAW ? packed->cluster : packed->block;
+    if (pread(packed->fd, dst, cluster->size, cluster->offset) != cluster->size) {
+        errno = EIO;
+        return -1;
+    }
+
+    if (!(cluster->flags & PACKED_RAW)) {
+        if (lz4_decompress(packed->block, cluster->size, packed->cluster, packed->header.cluster_size) != expected) {
+            errno = EIO;
+            return -1;
+        }
+        if (stats) {
+            stats->clusters_decompressed++;
+            stats->compressed_bytes_read += cluster->size;
+        }
+    }
+
+    packed->cached = index;
+    return 0;
+}
+
+ssize_t packed_read(struct packed_file *packed, void *buf, size_t len, off_t offset) {
+    size_t done = 0;
+    if (offset >= packed->header.file_size) return 0;
+    if (len > packed->header.file_size - offset) len = packed->header.file_size - offset;
+
+    // The cluster buffer is shared by every thread that faults
+    page_lock();
+    while (done < len) {
+        uint64_t position = offset + done;
+        uint32_t index = position / packed->header.cluster_size;
+        size_t within = position % packed->header.cluster_size;
+        size_t chunk = packed->header.cluster_size - within;
+        if (chunk > len - done) chunk = len - done;
+
+        if (load_cluster(packed, index) < 0) {
+            page_unlock();
+            return -1;
+        }
+        memcpy((char *)buf + done, packed->cluster + within, chunk);
+        done += chunk;
+    }
+    page_unlock();
+    return done;
+}
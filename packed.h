@@ -0,0 +1,49 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "loader.h"
+
+// Packed executables: an ELF file cut into fixed-size clusters, each
+// compressed as one LZ4 block, so the pagers can decompress on fault.
+// Layout: packed_header, cluster_count packed_cluster entries, then the
+// compressed clusters. Cluster i holds bytes [i, i + 1) * cluster_size of
+// the original file. elfpack writes these.
+
+#define PACKED_MAGIC 0x464c4550     // "PELF"
+#define PACKED_VERSION 1
+#define PACKED_CLUSTER_SIZE (16 * PAGE_SIZE)
+#define PACKED_RAW 1                // cluster is stored uncompressed
+
+struct packed_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t cluster_size;
+    uint32_t cluster_count;
+    uint64_t file_size;             // size of the original ELF
+};
+
+struct packed_cluster {
+    uint64_t offset;                // where the block starts in the packed file
+    uint32_t size;                  // its stored size
+    uint32_t flags;
+};
+
+struct packed_file {
+    int fd;
+    struct packed_header header;
+    struct packed_cluster *clusters;
+    unsigned char *block;           // one stored block, as read from the file
+    unsigned char *cluster;         // the most recently decompressed cluster
+    int64_t cached;                 // its index, -1 if none yet
+};
+
+// Returns NULL if `fd` is not a packed executable
+struct packed_file *packed_open(int fd);
+
+// pread() on the original ELF. Safe to call from the fault handler, and
+// from several threads: it holds page_lock while using the cluster buffer.
+ssize_t packed_read(struct packed_file *packed, void *buf, size_t len, off_t offset);
+
+#endif
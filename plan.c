@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "loader.h"
+#include "stats.h"
+#include "plan.h"
+
+static struct load_plan *plan = NULL;   // the plan this run was loaded from
+static int hot_fd = -1;                 // -H: faulted pages are appended here
+
+static int same_file(const struct plan_image *image, const struct stat *st) {
+    return image->dev == st->st_dev && image->ino == st->st_ino && image->size == st->st_size &&
+           image->mtime_sec == st->st_mtim.tv_sec && image->mtime_nsec == st->st_mtim.tv_nsec;
+}
+
+// Plans are named by an FNV-1a hash of the program path as given
+static void plan_path(const char *dir, const char *program, char *path, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char *p = program; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 0x100000001b3ULL;
+    }
+    snprintf(path, len, "%s/%016lx.plan", dir, hash);
+}
+
+static struct load_plan *map_plan(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(struct load_plan)) {
+        close(fd);
+        return NULL;
+    }
+
+    struct load_plan *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return NULL;
+
+    if (mapped->magic != PLAN_MAGIC || mapped->version != PLAN_VERSION ||
+        mapped->image_count < 1 || mapped->image_count > 2 ||
+        sizeof(*mapped) + mapped->hot_count * sizeof(uint32_t) != st.st_size) {
+        munmap(mapped, st.st_size);
+        return NULL;
+    }
+    return mapped;
+}
+
+static void unmap_plan(struct load_plan *mapped) {
+    munmap(mapped, sizeof(*mapped) + mapped->hot_count * sizeof(uint32_t));
+}
+
+static int plan_is_current(const struct load_plan *mapped, const char *program) {
+    if (strcmp(mapped->images[0].path, program) != 0) return 0;
+
+    for (uint32_t i = 0; i < mapped->image_count; i++) {
+        struct stat st;
+        if (stat(mapped->images[i].path, &st) != 0 || !same_file(&mapped->images[i], &st)) return 0;
+    }
+    return 1;
+}
+
+// A plan that can't be saved only costs the next launch a parse
+static void write_plan(const char *path, const struct load_plan *header, const uint32_t *hot) {
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(tmp);
+        return;
+    }
+
+    size_t hot_size = header->hot_count * sizeof(uint32_t);
+    if (write(fd, header, sizeof(*header)) != sizeof(*header) ||
+        (hot_size && write(fd, hot, hot_size) != hot_size)) {
+        perror("write");
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    close(fd);
+
+    if (rename(tmp, path) != 0) {
+        perror("rename");
+        unlink(tmp);
+    }
+}
+
+static void build_plan(const struct elf_image *images, int count, const char *program, struct load_plan *header) {
+    memset(header, 0, sizeof(*header));
+    header->magic = PLAN_MAGIC;
+    header->version = PLAN_VERSION;
+    header->image_count = count;
+
+    for (int i = 0; i < count; i++) {
+        const struct elf_image *image = &images[i];
+        struct plan_image *saved = &header->images[i];
+        struct stat st;
+        if (fstat(image->fd, &st) != 0) {
+            perror("fstat");
+            exit(EXIT_FAILURE);
+        }
+
+        saved->dev = st.st_dev;
+        saved->ino = st.st_ino;
+        saved->size = st.st_size;
+        saved->mtime_sec = st.st_mtim.tv_sec;
+        saved->mtime_nsec = st.st_mtim.tv_nsec;
+        saved->ehdr = image->ehdr;
+        saved->segment_count = image->segment_count;
+        for (int j = 0; j < image->segment_count; j++) {
+            saved->segments[j] = image->segments[j];
+            saved->segments[j].p_vaddr -= image->bias;
+        }
+        saved->relro = image->relro;
+        if (image->relro.p_type == PT_GNU_RELRO) saved->relro.p_vaddr -= image->bias;
+        strcpy(saved->path, i == 0 ? program : images[0].interp);
+        strcpy(saved->interp, image->interp);
+    }
+}
+
+static int compare_hot(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Rewrite the plan with the pages a -H run appended to `hot_path`
+static void fold_hot_pages(const char *path, const char *hot_path, const struct load_plan *mapped) {
+    int fd = open(hot_path, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return;
+    }
+
+    size_t recorded = st.st_size / sizeof(uint32_t);
+    uint32_t *hot = malloc((mapped->hot_count + recorded) * sizeof(uint32_t));
+    memcpy(hot, mapped->hot, mapped->hot_count * sizeof(uint32_t));
+    ssize_t read_bytes = read(fd, hot + mapped->hot_count, recorded * sizeof(uint32_t));
+    close(fd);
+    if (read_bytes < 0) read_bytes = 0;
+
+    size_t count = mapped->hot_count + read_bytes / sizeof(uint32_t);
+    qsort(hot, count, sizeof(uint32_t), compare_hot);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique == 0 || hot[unique - 1] != hot[i]) hot[unique++] = hot[i];
+    }
+
+    struct load_plan header = *mapped;
+    header.hot_count = unique;
+    write_plan(path, &header, hot);
+    unlink(hot_path);
+    free(hot);
+}
+
+static void image_from_plan(const struct plan_image *saved, int id, struct elf_image *image) {
+    memset(image, 0, sizeof(*image));
+    image->id = id;
+
+    open_image_file(saved->path, image);
+    image->ehdr = saved->ehdr;
+    image->segment_count = saved->segment_count;
+    memcpy(image->segments, saved->segments, sizeof(image->segments));
+    image->relro = saved->relro;
+    strcpy(image->interp, saved->interp);
+
+    reserve_image(saved->path, image);
+}
+
+int load_images_cached(const char *dir, const char *program, struct elf_image images[2]) {
+    char path[PATH_MAX], hot_path[PATH_MAX + 8];
+    plan_path(dir, program, path, sizeof(path));
+    snprintf(hot_path, sizeof(hot_path), "%s.hot", path);
+
+    plan = map_plan(path);
+    if (plan && !plan_is_current(plan, program)) {
+        // Recorded pages describe the old binary as much as the plan does
+        unmap_plan(plan);
+        plan = NULL;
+        unlink(hot_path);
+    }
+
+    if (plan && access(hot_path, F_OK) == 0) {
+        fold_hot_pages(path, hot_path, plan);
+        unmap_plan(plan);
+        plan = map_plan(path);
+    }
+
+    int count;
+    if (plan) {
+        count = plan->image_count;
+        for (int i = 0; i < count; i++) {
+            image_from_plan(&plan->images[i], i, &images[i]);
+        }
+        if (stats) stats->plan_hot_pages = plan->hot_count;
+    } else {
+        count = open_images(program, images);
+
+        struct load_plan *header = malloc(sizeof(*header));
+        build_plan(images, count, program, header);
+        write_plan(path, header, NULL);
+        free(header);
+    }
+    if (stats) stats->plan_hit = plan != NULL;
+
+    if (options.record_hot) {
+        hot_fd = open(hot_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (hot_fd < 0) perror(hot_path);
+    }
+    return count;
+}
+
+void plan_prefault(struct elf_image *images, int count) {
+    if (!plan) return;
+
+    for (uint32_t i = 0; i < plan->hot_count; i++) {
+        uint32_t id = plan->hot[i] >> 31;
+        uint32_t index = plan->hot[i] & 0x7fffffff;
+        if (id < count) {
+            map_page(&images[id], images[id].map_start + (uintptr_t)index * PAGE_SIZE);
+        }
+    }
+}
+
+void plan_record_page(const struct elf_image *image, uintptr_t page) {
+    if (hot_fd < 0) return;
+
+    uint32_t entry = (uint32_t)image->id << 31 | (page - image->map_start) / PAGE_SIZE;
+    // Losing a sample only makes the next prefault less complete
+    if (write(hot_fd, &entry, sizeof(entry)) < 0) return;
+}
@@ -0,0 +1,47 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stdint.h>
+#include <limits.h>
+#include "loader.h"
+
+// A load plan is everything the loader learns from an ELF before mapping it,
+// saved so repeated launches skip parsing and validation. Plans live in the
+// -p directory, one file per program path, and are used only while the
+// program's and interpreter's device, inode, size and mtime still match.
+
+#define PLAN_MAGIC 0x4e414c50   // "PLAN"
+#define PLAN_VERSION 1
+
+struct plan_image {
+    uint64_t dev, ino, size;            // identity of the file the plan came from
+    int64_t mtime_sec, mtime_nsec;
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr segments[MAX_PHDR_COUNT];    // PT_LOADs, not relocated
+    int segment_count;
+    Elf64_Phdr relro;
+    char path[PATH_MAX];
+    char interp[PATH_MAX];
+};
+
+struct load_plan {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t image_count;
+    uint32_t hot_count;
+    struct plan_image images[2];
+    uint32_t hot[];     // recorded hot pages: image id << 31 | page index in the image
+};
+
+// load_images through the cache: map the plan for `program` from `dir` if it
+// is current, otherwise parse the ELF files and save a new plan. Pages that
+// -H recorded on earlier runs are folded into the plan here.
+int load_images_cached(const char *dir, const char *program, struct elf_image images[2]);
+
+// Map the plan's recorded hot pages up front (demand pagers)
+void plan_prefault(struct elf_image *images, int count);
+
+// With -H, note a page the fault handler had to map. Async-signal-safe.
+void plan_record_page(const struct elf_image *image, uintptr_t page);
+
+#endif
@@ -0,0 +1,351 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <sys/mman.h>
+
+// Pool allocator, loaded with LD_PRELOAD=./poolmalloc.so in place of
+// glibc's malloc. Blocks up to 256 KiB come in 52 size classes carved out
+// of 64 KiB spans of one big reserved region; each thread keeps a free list
+// per class and trades whole batches with a locked central pool, so the
+// common malloc and free touch no shared state at all. Bigger blocks are
+// mmap'd one by one. Span memory is reused but never returned to the
+// system.
+
+#define REGION_SIZE (16ULL << 30)      // reserved, committed as touched
+#define SPAN_SIZE (64 * 1024)
+#define SPAN_COUNT (REGION_SIZE / SPAN_SIZE)
+#define MAX_SMALL (256 * 1024)
+#define CLASS_COUNT 52
+#define LARGE_MAGIC 0x4c415247454d4150ULL
+#define PAGE_SIZE 4096
+
+struct block {
+    struct block *next;         // within a batch or a thread's list
+    struct block *next_batch;   // in the central pool, on a batch's first block
+};
+
+struct central {
+    pthread_mutex_t lock;
+    struct block *batches;
+} __attribute__((aligned(64)));
+
+struct thread_cache {
+    struct block *head;
+    uint32_t count;
+};
+
+// Just before a large block: where its mapping starts and how long it is
+struct large_header {
+    uint64_t magic;
+    void *base;
+    size_t length;
+    size_t pad;
+};
+
+static char *region;
+static _Atomic size_t region_used;
+static uint8_t span_class[SPAN_COUNT];              // size class of each carved span
+static uint32_t class_size[CLASS_COUNT];
+static uint32_t class_batch[CLASS_COUNT];           // blocks moved to or from the pool at once
+static struct central pool[CLASS_COUNT];
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+
+static __thread struct thread_cache caches[CLASS_COUNT] __attribute__((tls_model("initial-exec")));
+static __thread int cache_registered __attribute__((tls_model("initial-exec")));
+
+static void flush_thread(void *arg);
+
+static void lock_all(void) {
+    for (int c = 0; c < CLASS_COUNT; c++) pthread_mutex_lock(&pool[c].lock);
+}
+
+static void unlock_all(void) {
+    for (int c = 0; c < CLASS_COUNT; c++) pthread_mutex_unlock(&pool[c].lock);
+}
+
+// 16-byte steps to 128, then four classes per doubling up to MAX_SMALL
+static void init(void) {
+    int c = 0;
+    for (uint32_t size = 16; size <= 128; size += 16) class_size[c++] = size;
+    for (uint32_t base = 128; base < MAX_SMALL; base *= 2) {
+        for (int i = 1; i <= 4; i++) class_size[c++] = base + i * base / 4;
+    }
+
+    for (c = 0; c < CLASS_COUNT; c++) {
+        uint32_t batch = 32768 / class_size[c];
+        class_batch[c] = batch < 2 ? 2 : batch > 128 ? 128 : batch;
+        pthread_mutex_init(&pool[c].lock, NULL);
+    }
+
+    region = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        static const char message[] = "poolmalloc: cannot reserve the arena\n";
+        if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0) _exit(127);
+        _exit(127);
+    }
+    pthread_key_create(&cache_key, flush_thread);
+    pthread_atfork(lock_all, unlock_all, unlock_all);
+}
+
+// The smallest class that holds `size` (at most MAX_SMALL)
+static int size_class(size_t size) {
+    if (size <= 128) return size ? (size - 1) / 16 : 0;
+    size_t s = size - 1;
+    int log = 63 - __builtin_clzl(s);
+    return 8 + 4 * (log - 7) + (s - (1UL << log)) / (1UL << (log - 2));
+}
+
+// Before the first allocation there is no region, and nothing is in it
+static int in_region(const void *p) {
+    return region && (const char *)p >= region && (const char *)p < region + REGION_SIZE;
+}
+
+static int class_of(const void *p) {
+    return span_class[((const char *)p - region) / SPAN_SIZE];
+}
+
+// Fresh blocks, as a list. Big classes get several spans at once so a
+// carve yields at least four blocks.
+static struct block *carve_span(int c, uint32_t *count) {
+    size_t length = class_size[c] <= SPAN_SIZE / 4 ? SPAN_SIZE
+                                                   : (4 * class_size[c] + SPAN_SIZE - 1) & ~(size_t)(SPAN_SIZE - 1);
+    size_t start = atomic_fetch_add(&region_used, length);
+    if (start + length > REGION_SIZE) return NULL;
+    memset(&span_class[start / SPAN_SIZE], c, length / SPAN_SIZE);
+
+    char *span = region + start;
+    uint32_t n = length / class_size[c];
+    for (uint32_t i = 0; i < n; i++) {
+        ((struct block *)(span + (size_t)i * class_size[c]))->next =
+            i + 1 < n ? (struct block *)(span + (size_t)(i + 1) * class_size[c]) : NULL;
+    }
+    *count = n;
+    return (struct block *)span;
+}
+
+// The key's destructor hands the thread's lists back when it exits
+static void register_cache(void) {
+    cache_registered = 1;
+    pthread_setspecific(cache_key, caches);
+}
+
+// Refill an empty thread list with a batch from the pool, or a new span
+static int refill(struct thread_cache *cache, int c) {
+    if (!cache_registered) register_cache();
+
+    pthread_mutex_lock(&pool[c].lock);
+    struct block *batch = pool[c].batches;
+    if (batch) pool[c].batches = batch->next_batch;
+    pthread_mutex_unlock(&pool[c].lock);
+
+    if (batch) {
+        // Batches handed back by exiting threads can be short
+        cache->head = batch;
+        cache->count = 0;
+        for (struct block *b = batch; b; b = b->next) cache->count++;
+        return 1;
+    }
+    cache->head = carve_span(c, &cache->count);
+    return cache->head != NULL;
+}
+
+// Move `count` blocks off the front of `cache` into the pool as one batch
+static void release_batch(struct thread_cache *cache, int c, uint32_t count) {
+    struct block *first = cache->head, *last = first;
+    for (uint32_t i = 1; i < count; i++) last = last->next;
+    cache->head = last->next;
+    cache->count -= count;
+    last->next = NULL;
+
+    pthread_mutex_lock(&pool[c].lock);
+    first->next_batch = pool[c].batches;
+    pool[c].batches = first;
+    pthread_mutex_unlock(&pool[c].lock);
+}
+
+static void flush_thread(void *arg) {
+    struct thread_cache *mine = arg;
+    for (int c = 0; c < CLASS_COUNT; c++) {
+        while (mine[c].count > 0) {
+            release_batch(&mine[c], c, mine[c].count < class_batch[c] ? mine[c].count : class_batch[c]);
+        }
+        mine[c].head = NULL;
+    }
+}
+
+static void *small_alloc(int c) {
+    struct thread_cache *cache = &caches[c];
+    if (!cache->head && !refill(cache, c)) return NULL;
+
+    struct block *b = cache->head;
+    cache->head = b->next;
+    cache->count--;
+    return b;
+}
+
+static void small_free(void *p) {
+    int c = class_of(p);
+    struct thread_cache *cache = &caches[c];
+    if (!cache_registered) register_cache();
+    struct block *b = p;
+    b->next = cache->head;
+    cache->head = b;
+    if (++cache->count > 2 * class_batch[c]) release_batch(cache, c, class_batch[c]);
+}
+
+// `align` is a power of two of at least 16
+static void *large_alloc(size_t size, size_t align) {
+    size_t offset = align > sizeof(struct large_header) ? align : sizeof(struct large_header);
+    size_t length = (offset + size + align + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    if (length < size) return NULL;
+    char *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return NULL;
+
+    char *p = (char *)(((uintptr_t)base + offset + align - 1) & ~(uintptr_t)(align - 1));
+    struct large_header *header = (struct large_header *)p - 1;
+    header->magic = LARGE_MAGIC;
+    header->base = base;
+    header->length = length;
+    return p;
+}
+
+static struct large_header *large_header_of(void *p) {
+    struct large_header *header = (struct large_header *)p - 1;
+    return header->magic == LARGE_MAGIC ? header : NULL;
+}
+
+static size_t usable_size(void *p) {
+    if (in_region(p)) return class_size[class_of(p)];
+    struct large_header *header = large_header_of(p);
+    return header ? header->length - ((char *)p - (char *)header->base) : 0;
+}
+
+static void *allocate(size_t size, size_t align) {
+    pthread_once(&init_once, init);
+
+    void *p;
+    if (align <= 16 && size <= MAX_SMALL) {
+        p = small_alloc(size_class(size));
+    } else if (size <= MAX_SMALL && align <= PAGE_SIZE) {
+        // Spans are aligned, so a block is aligned when its class size is
+        // a multiple of `align`; powers of two always are
+        size_t rounded = (size + align - 1) & ~(align - 1);
+        int c = rounded <= MAX_SMALL ? size_class(rounded) : -1;
+        if (c >= 0 && class_size[c] % align != 0) {
+            size_t pow2 = align;
+            while (pow2 < rounded) pow2 *= 2;
+            c = pow2 <= MAX_SMALL ? size_class(pow2) : -1;
+        }
+        p = c >= 0 ? small_alloc(c) : large_alloc(size, align);
+    } else {
+        p = large_alloc(size, align < 16 ? 16 : align);
+    }
+    if (!p) errno = ENOMEM;
+    return p;
+}
+
+void *malloc(size_t size) {
+    return allocate(size, 16);
+}
+
+void free(void *p) {
+    if (!p) return;
+    if (in_region(p)) {
+        small_free(p);
+        return;
+    }
+    // Anything else that isn't ours predates the preload; leak it
+    struct large_header *header = large_header_of(p);
+    if (header) {
+        header->magic = 0;
+        munmap(header->base, header->length);
+    }
+}
+
+void *calloc(size_t count, size_t size) {
+    if (count && size > SIZE_MAX / count) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *p = allocate(count * size, 16);
+    // Large blocks are fresh mappings, already zero
+    if (p && in_region(p)) memset(p, 0, count * size);
+    return p;
+}
+
+void *realloc(void *old, size_t size) {
+    if (!old) return malloc(size);
+    if (size == 0) {
+        free(old);
+        return NULL;
+    }
+
+    size_t have = usable_size(old);
+    if (have == 0) {
+        // Not ours, so there is no telling how much of it to copy; failing
+        // loudly beats handing back a block with the data missing
+        static const char message[] = "poolmalloc: realloc of a block it did not allocate\n";
+        if (write(STDERR_FILENO, message, sizeof(message) - 1) < 0) abort();
+        abort();
+    }
+    if (size <= have && (in_region(old) || size > MAX_SMALL)) return old;
+
+    struct large_header *header = in_region(old) ? NULL : large_header_of(old);
+    if (header && size > MAX_SMALL && (char *)old - (char *)header->base == sizeof(*header)) {
+        // Let the kernel move the pages instead of copying them
+        size_t length = (sizeof(*header) + size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+        char *base = mremap(header->base, header->length, length, MREMAP_MAYMOVE);
+        if (base == MAP_FAILED) return NULL;
+        header = (struct large_header *)base;
+        header->base = base;
+        header->length = length;
+        return header + 1;
+    }
+
+    void *p = malloc(size);
+    if (p) {
+        memcpy(p, old, have < size ? have : size);
+        free(old);
+    }
+    return p;
+}
+
+int posix_memalign(void **out, size_t align, size_t size) {
+    if (align < sizeof(void *) || (align & (align - 1)) != 0) return EINVAL;
+    void *p = allocate(size, align);
+    if (!p) return ENOMEM;
+    *out = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+    if (align == 0 || (align & (align - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return allocate(size, align);
+}
+
+void *memalign(size_t align, size_t size) {
+    return aligned_alloc(align, size);
+}
+
+void *valloc(size_t size) {
+    return allocate(size, PAGE_SIZE);
+}
+
+void *pvalloc(size_t size) {
+    return allocate((size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1), PAGE_SIZE);
+}
+
+size_t malloc_usable_size(void *p) {
+    return p ? usable_size(p) : 0;
+}
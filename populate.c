@@ -0,0 +1,93 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "loader.h"
+#include "stats.h"
+#include "populate.h"
+
+struct chunk {
+    uintptr_t start, end;
+};
+
+static struct chunk *chunks;
+static int chunk_count;
+static int next_chunk;      // shared work queue: the next chunk nobody has taken
+
+static void populate_chunk(const struct chunk *chunk) {
+    if (madvise((void *)chunk->start, chunk->end - chunk->start, MADV_POPULATE_READ) == 0) return;
+
+    // Kernels before 5.14 don't have MADV_POPULATE_READ; take the faults by hand
+    for (uintptr_t p = chunk->start; p < chunk->end; p += PAGE_SIZE) {
+        (void)*(volatile char *)p;
+    }
+}
+
+static void *populate_worker(void *arg) {
+    int i;
+    while ((i = __atomic_fetch_add(&next_chunk, 1, __ATOMIC_RELAXED)) < chunk_count) {
+        populate_chunk(&chunks[i]);
+    }
+    return NULL;
+}
+
+// Packed images were decompressed into anonymous memory by map_segment, and
+// unreadable segments can't be populated for reading
+static int populated_range(const struct elf_image *image, const Elf64_Phdr *phdr, uintptr_t *lo, uintptr_t *hi) {
+    if (image->packed || !(phdr->p_flags & PF_R) || phdr->p_filesz == 0) return 0;
+    *lo = PAGE_ALIGN_DOWN(phdr->p_vaddr);
+    *hi = PAGE_ALIGN_UP(phdr->p_vaddr + phdr->p_filesz);
+    return 1;
+}
+
+void populate_images(struct elf_image *images, int count, int threads) {
+    uint64_t start = now_ns();
+    if (threads < 1) threads = 1;
+    if (threads > POPULATE_MAX_THREADS) threads = POPULATE_MAX_THREADS;
+
+    int capacity = 0;
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < images[i].segment_count; j++) {
+            uintptr_t lo, hi;
+            if (populated_range(&images[i], &images[i].segments[j], &lo, &hi)) {
+                capacity += (hi - lo + POPULATE_CHUNK_SIZE - 1) / POPULATE_CHUNK_SIZE;
+            }
+        }
+    }
+    if (capacity == 0) return;
+
+    chunks = malloc(capacity * sizeof(struct chunk));
+    chunk_count = 0;
+    next_chunk = 0;
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < images[i].segment_count; j++) {
+            uintptr_t lo, hi;
+            if (!populated_range(&images[i], &images[i].segments[j], &lo, &hi)) continue;
+            for (uintptr_t p = lo; p < hi; p += POPULATE_CHUNK_SIZE) {
+                chunks[chunk_count].start = p;
+                chunks[chunk_count].end = hi - p > POPULATE_CHUNK_SIZE ? p + POPULATE_CHUNK_SIZE : hi;
+                chunk_count++;
+            }
+        }
+    }
+    if (threads > chunk_count) threads = chunk_count;
+
+    // The calling thread works the queue too
+    pthread_t workers[POPULATE_MAX_THREADS];
+    int started = 0;
+    for (; started < threads - 1; started++) {
+        if (pthread_create(&workers[started], NULL, populate_worker, NULL) != 0) break;
+    }
+    populate_worker(NULL);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(chunks);
+
+    if (stats) {
+        stats->populate_threads = started + 1;
+        stats->populate_chunks = chunk_count;
+        stats->populate_ns = now_ns() - start;
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef POPULATE_H
+#define POPULATE_H
+
+#include "loader.h"
+
+// Eager population for apager's -j mode. map_segment only sets up file
+// mappings; the kernel still reads them in one fault at a time once the
+// program runs. This splits every file-backed segment into chunks and faults
+// them in from a pool of threads, so the reads overlap, and returns only once
+// every chunk is resident.
+
+#define POPULATE_CHUNK_SIZE (4 * 1024 * 1024)
+#define POPULATE_MAX_THREADS 64
+
+// Populate the file-backed part of every segment with `threads` threads
+// (1 populates serially on the calling thread)
+void populate_images(struct elf_image *images, int count, int threads);
+
+#endif
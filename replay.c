@@ -0,0 +1,358 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "iotrace.h"
+#include "replay.h"
+
+struct call {
+    uint64_t due;       // ns after the first traced call
+    uint64_t offset;
+    uint32_t length;
+    uint16_t op;        // IOTRACE_PREAD, IOTRACE_PWRITE or IOTRACE_FSYNC
+    uint16_t traced_us;
+};
+
+static struct call *calls;
+static size_t call_count;
+static uint32_t max_length;
+static uint64_t traced_span;
+static _Atomic size_t next_call;
+static _Atomic uint64_t total_latency;
+static uint64_t start;
+static int replay_fd;
+static int replay_timed;
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns) {
+    struct timespec until = { ns / 1000000000, ns % 1000000000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+}
+
+static int compare_time(const void *a, const void *b) {
+    const struct iotrace_record *x = a, *y = b;
+    return (x->ns > y->ns) - (x->ns < y->ns);
+}
+
+// Read the trace and keep the calls worth reissuing, in time order
+static void load(const char *path, uint64_t file_size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        exit(EXIT_FAILURE);
+    }
+
+    struct iotrace_header header;
+    if (st.st_size < sizeof(header) || read(fd, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != IOTRACE_MAGIC || header.version != IOTRACE_VERSION ||
+        header.record_size != sizeof(struct iotrace_record)) {
+        fprintf(stderr, "%s: not an I/O trace.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t count = (st.st_size - sizeof(header)) / sizeof(struct iotrace_record);
+    struct iotrace_record *records = malloc(count * sizeof(struct iotrace_record) + 1);
+    calls = malloc(count * sizeof(struct call) + 1);
+    if (!records || !calls ||
+        pread(fd, records, count * sizeof(struct iotrace_record), sizeof(header)) !=
+            (ssize_t)(count * sizeof(struct iotrace_record))) {
+        perror("read");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    qsort(records, count, sizeof(struct iotrace_record), compare_time);
+
+    uint64_t first = 0, last = 0;
+    for (size_t i = 0; i < count; i++) {
+        const struct iotrace_record *rec = &records[i];
+        if (rec->op < IOTRACE_READ || rec->op > IOTRACE_FSYNC || rec->op == IOTRACE_LSEEK) continue;
+        if (rec->op != IOTRACE_FSYNC && (rec->offset < 0 || rec->length <= 0)) continue;
+
+        struct call *call = &calls[call_count++];
+        if (!first) first = rec->ns;
+        last = rec->ns;
+        call->due = rec->ns - first;
+        call->offset = file_size ? (uint64_t)rec->offset % file_size : (uint64_t)rec->offset;
+        call->length = rec->op == IOTRACE_FSYNC ? 0 : rec->length;
+        call->op = rec->op == IOTRACE_READ ? IOTRACE_PREAD : rec->op == IOTRACE_WRITE ? IOTRACE_PWRITE : rec->op;
+        call->traced_us = rec->latency_us;
+        if (call->length > max_length) max_length = call->length;
+    }
+    traced_span = last - first;
+    free(records);
+}
+
+static void check(const struct call *call, ssize_t result) {
+    if (result < 0) {
+        perror(call->op == IOTRACE_PREAD ? "pread" : call->op == IOTRACE_PWRITE ? "pwrite" : "fdatasync");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void *worker(void *arg) {
+    (void) arg;
+
+    char *buf;
+    if (posix_memalign((void **)&buf, 4096, max_length + 1)) {
+        perror("posix_memalign");
+        exit(EXIT_FAILURE);
+    }
+    memset(buf, 'A', max_length + 1);
+
+    uint64_t latency = 0;
+    for (;;) {
+        size_t i = atomic_fetch_add(&next_call, 1);
+        if (i >= call_count) break;
+        const struct call *call = &calls[i];
+        if (replay_timed) sleep_until(start + call->due);
+
+        uint64_t issued = now_ns();
+        ssize_t result = call->op == IOTRACE_PREAD  ? pread(replay_fd, buf, call->length, call->offset)
+                         : call->op == IOTRACE_PWRITE ? pwrite(replay_fd, buf, call->length, call->offset)
+                                                      : fdatasync(replay_fd);
+        check(call, result);
+        latency += now_ns() - issued;
+    }
+    atomic_fetch_add(&total_latency, latency);
+    free(buf);
+    return NULL;
+}
+
+static void replay_threads(int workers) {
+    pthread_t *threads = malloc(workers * sizeof(pthread_t));
+    if (!threads) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < workers; i++) pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+// An io_uring set up by hand; there's no liburing to lean on here
+struct uring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+};
+
+static void uring_setup(struct uring *ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        perror("io_uring_setup");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+
+    char *sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    char *cq = params.features & IORING_FEAT_SINGLE_MMAP
+                   ? sq
+                   : mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                          IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+}
+
+// Submit what's queued and wait for `wait` completions, at most until
+// `deadline` if it isn't 0
+static void uring_enter(struct uring *ring, unsigned submit, unsigned wait, uint64_t deadline) {
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec timeout;
+    struct io_uring_getevents_arg arg = { 0 };
+    void *argp = NULL;
+    size_t argsz = 0;
+    if (wait && deadline) {
+        uint64_t now = now_ns(), left = deadline > now ? deadline - now : 0;
+        timeout.tv_sec = left / 1000000000;
+        timeout.tv_nsec = left % 1000000000;
+        arg.ts = (uintptr_t)&timeout;
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+    while (syscall(__NR_io_uring_enter, ring->fd, submit, wait, flags, argp, argsz) < 0) {
+        if (errno == ETIME) return;
+        if (errno != EINTR) {
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+struct slot {
+    size_t call;
+    uint64_t issued;
+    char *buf;
+};
+
+static void replay_uring(int depth) {
+    struct uring ring;
+    uring_setup(&ring, depth);
+
+    // A buffer per request in flight; `free_slots` is a stack of unused ones
+    struct slot *slots = calloc(depth, sizeof(struct slot));
+    int *free_slots = malloc(depth * sizeof(int));
+    if (!slots || !free_slots) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < depth; i++) {
+        if (posix_memalign((void **)&slots[i].buf, 4096, max_length + 1)) {
+            perror("posix_memalign");
+            exit(EXIT_FAILURE);
+        }
+        memset(slots[i].buf, 'A', max_length + 1);
+        free_slots[i] = depth - 1 - i;
+    }
+
+    int unused = depth;
+    size_t next = 0;
+    uint64_t latency = 0;
+    while (next < call_count || unused < depth) {
+        // Queue everything that is due while there's room
+        unsigned queued = 0;
+        unsigned tail = *ring.sq_tail;
+        while (next < call_count && unused > 0 && (!replay_timed || start + calls[next].due <= now_ns())) {
+            const struct call *call = &calls[next];
+            int s = free_slots[--unused];
+            slots[s].call = next++;
+
+            unsigned index = tail & *ring.sq_mask;
+            struct io_uring_sqe *sqe = &ring.sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = call->op == IOTRACE_PREAD  ? IORING_OP_READ
+                          : call->op == IOTRACE_PWRITE ? IORING_OP_WRITE
+                                                       : IORING_OP_FSYNC;
+            sqe->fd = replay_fd;
+            sqe->off = call->offset;
+            if (call->op == IOTRACE_FSYNC) {
+                sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+            } else {
+                sqe->addr = (uintptr_t)slots[s].buf;
+                sqe->len = call->length;
+            }
+            sqe->user_data = s;
+            ring.sq_array[index] = index;
+            tail++;
+            queued++;
+            slots[s].issued = now_ns();
+        }
+        __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+        // Wait for a completion, or until the next call is due
+        uint64_t deadline = replay_timed && next < call_count && unused > 0 ? start + calls[next].due : 0;
+        if (unused < depth) {
+            uring_enter(&ring, queued, 1, deadline);
+        } else if (queued) {
+            uring_enter(&ring, queued, 0, 0);
+        } else if (deadline) {
+            sleep_until(deadline);
+        }
+
+        unsigned head = *ring.cq_head;
+        while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            struct slot *slot = &slots[cqe->user_data];
+            if (cqe->res < 0) {
+                errno = -cqe->res;
+                check(&calls[slot->call], -1);
+            }
+            latency += now_ns() - slot->issued;
+            free_slots[unused++] = cqe->user_data;
+            head++;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    total_latency = latency;
+
+    for (int i = 0; i < depth; i++) free(slots[i].buf);
+    free(slots);
+    free(free_slots);
+    close(ring.fd);
+}
+
+void replay(int fd, const char *trace_path, const struct replay_options *options) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("fstat");
+        exit(EXIT_FAILURE);
+    }
+    load(trace_path, st.st_size);
+    if (call_count == 0) {
+        fprintf(stderr, "%s: nothing to replay.\n", trace_path);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t bytes = 0, traced_latency = 0;
+    for (size_t i = 0; i < call_count; i++) {
+        bytes += calls[i].length;
+        traced_latency += calls[i].traced_us;
+    }
+
+    replay_fd = fd;
+    replay_timed = options->timed;
+    start = now_ns();
+    if (options->engine == REPLAY_URING) {
+        replay_uring(options->workers);
+    } else {
+        replay_threads(options->workers);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    printf("replayed %zu calls, %lu bytes, with %d %s, %s\n", call_count, bytes, options->workers,
+           options->engine == REPLAY_URING ? "io_uring slots" : "threads",
+           options->timed ? "at the traced times" : "as fast as possible");
+    printf("%10s %12s %12s %16s\n", "", "elapsed ms", "calls/s", "mean latency us");
+    printf("%10s %12.1f %12.0f %16.1f\n", "traced", traced_span / 1e6,
+           traced_span ? call_count / (traced_span / 1e9) : 0, (double)traced_latency / call_count);
+    printf("%10s %12.1f %12.0f %16.1f\n", "replay", elapsed / 1e6, call_count / (elapsed / 1e9),
+           total_latency / 1e3 / call_count);
+    free(calls);
+}
@@ -0,0 +1,25 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// Replays an I/O trace written by iotrace.so against one test file: every
+// read, write and fsync in it is reissued with its original length, at its
+// original offset (wrapped to fit the file), on `fd`. Descriptors that
+// couldn't seek are skipped, and so are calls that failed. An fsync is
+// not a barrier: with several workers, writes after it can overtake it.
+
+enum replay_engine {
+    REPLAY_THREADS,     // `workers` threads doing pread/pwrite
+    REPLAY_URING,       // one thread keeping up to `workers` requests in an io_uring
+};
+
+struct replay_options {
+    enum replay_engine engine;
+    int workers;
+    int timed;          // issue each call at its traced time, not as soon as possible
+};
+
+// Prints what the replay did and how long it took next to the traced
+// figures. Exits on errors.
+void replay(int fd, const char *trace_path, const struct replay_options *options);
+
+#endif
@@ -0,0 +1,68 @@
+#!/bin/bash
+
+# Compare glibc malloc with poolmalloc.so on alloc_bench's churn at several
+# thread counts. Usage: ./run_alloc_bench.sh [threads...]   (default: 1 2 4 8)
+# REPS=n averages n runs per cell (default 3); STEPS and MAX_SIZE are
+# passed to alloc_bench.
+
+reps=${REPS:-3}
+steps=${STEPS:-1000000}
+max_size=${MAX_SIZE:-262144}
+allocators=("glibc" "poolmalloc")
+fields=("wall_ns" "ns_per_op" "maxrss_kb")
+
+if [ $# -gt 0 ]; then
+    thread_counts=("$@")
+else
+    thread_counts=(1 2 4 8)
+fi
+if [ ! -x ./alloc_bench ] || [ ! -f ./poolmalloc.so ]; then
+    echo "Build alloc_bench and poolmalloc.so first ('make alloc_bench poolmalloc.so')." >&2
+    exit 1
+fi
+
+timestamp=$(date +"%Y%m%d_%H%M%S")
+result_file="alloc_results_$timestamp.csv"
+report=$(mktemp)
+trap 'rm -f "$report"' EXIT
+
+(IFS=,; echo "Threads,Allocator,Runs,${fields[*]}") > $result_file
+
+# Prints the averages of `fields` over `reps` runs, comma separated
+run_bench() {
+    local allocator=$1
+    local threads=$2
+    local preload=""
+
+    if [ "$allocator" = "poolmalloc" ]; then
+        preload="$PWD/poolmalloc.so"
+    fi
+    : > "$report"
+    for ((run = 0; run < reps; run++)); do
+        if ! LD_PRELOAD=$preload ./alloc_bench $threads $steps $max_size >> "$report"; then
+            echo "alloc_bench failed under $allocator" >&2
+            return 1
+        fi
+    done
+
+    # ns_per_op is fractional, so average in awk rather than in the shell
+    awk -v keys="${fields[*]}" -v reps=$reps '
+        { sum[$1] += $2 }
+        END { n = split(keys, key, " "); for (i = 1; i <= n; i++) printf "%s%.1f", (i > 1 ? "," : ""), sum[key[i]] / reps; printf "\n" }' "$report"
+}
+
+for threads in "${thread_counts[@]}"; do
+    for allocator in "${allocators[@]}"; do
+        echo "Running $threads threads under $allocator..." >&2
+        if averages=$(run_bench $allocator $threads); then
+            echo "$threads,$allocator,$reps,$averages" >> $result_file
+        else
+            echo "$threads,$allocator,0$(printf ',%.0s' "${fields[@]}")" >> $result_file
+        fi
+    done
+done
+
+# Aligned table on stdout (column(1) isn't everywhere)
+awk -F, '{ for (i = 1; i <= NF; i++) { cell[NR, i] = $i; if (length($i) > width[i]) width[i] = length($i) } }
+         END { for (r = 1; r <= NR; r++) { for (i = 1; i <= NF; i++) printf "%-*s  ", width[i], cell[r, i]; printf "\n" } }' $result_file
+echo "Results written to $result_file"
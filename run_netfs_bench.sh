@@ -0,0 +1,107 @@
+#!/bin/bash
+
+# Run netfs_bench's tests through netfs against a local netfs_server on a
+# Unix socket, over several emulated links and cache modes, and collect the
+# results into one table. Usage: ./run_netfs_bench.sh [test...]
+# (default: seqread randread meta write). Each test runs twice per mount:
+# a cold pass on an empty cache, then a warm one.
+# LINKS lists "rtt-ms:MiB/s" pairs, 0 meaning none (default "0:0 1:100 20:10").
+# MODES picks from block, whole, nottl and single (default: all four).
+
+links=(${LINKS:-0:0 1:100 20:10})
+modes=(${MODES:-block whole nottl single})
+passes=("cold" "warm")
+fields=("mib_per_s" "ops_per_s" "mean_us" "p50_us" "p99_us" "sync_ns")
+
+if [ $# -gt 0 ]; then
+    tests=("$@")
+else
+    tests=(seqread randread meta write)
+fi
+if [ ! -x ./netfs ] || [ ! -x ./netfs_server ] || [ ! -x ./netfs_bench ]; then
+    echo "Build netfs, netfs_server and netfs_bench first ('make netfs netfs_server netfs_bench')." >&2
+    exit 1
+fi
+unmount=$(command -v fusermount3 || command -v fusermount)
+
+# netfs flags for each cache mode
+mode_flags() {
+    case $1 in
+    block) echo "" ;;           # block cache, 1 s attribute TTL, 4 connections
+    whole) echo "-w" ;;         # whole-file cache
+    nottl) echo "-t 0" ;;       # block cache, attributes revalidated every time
+    single) echo "-n 1" ;;      # block cache over one connection
+    *) echo "Unknown mode $1" >&2; return 1 ;;
+    esac
+}
+
+timestamp=$(date +"%Y%m%d_%H%M%S")
+result_file="netfs_results_$timestamp.csv"
+work=$(mktemp -d)
+export_dir="$work/export"
+mountpoint="$work/mnt"
+socket="$work/netfs.sock"
+report="$work/report"
+server=""
+
+cleanup() {
+    mountpoint -q "$mountpoint" 2> /dev/null && $unmount -u "$mountpoint"
+    [ -n "$server" ] && kill $server 2> /dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+mkdir -p "$export_dir" "$mountpoint"
+./netfs_bench "$export_dir" setup || exit 1
+
+(IFS=,; echo "Link,Mode,Test,Pass,${fields[*]}") > $result_file
+
+# Prints `fields` from the last report, comma separated
+report_fields() {
+    local values=()
+    for i in "${!fields[@]}"; do
+        values[$i]=$(awk -v key="${fields[$i]}" '$1 == key {print $2}' "$report")
+    done
+    (IFS=,; echo "${values[*]}")
+}
+
+for link in "${links[@]}"; do
+    rtt=${link%%:*}
+    bandwidth=${link##*:}
+    rm -f "$socket"
+    ./netfs_server -r $rtt -b $bandwidth "$socket" "$export_dir" &
+    server=$!
+    while [ ! -S "$socket" ]; do sleep 0.1; done
+
+    for mode in "${modes[@]}"; do
+        flags=$(mode_flags $mode) || continue
+        for test in "${tests[@]}"; do
+            # A fresh mount and cache for every test, so the cold pass is cold
+            rm -rf "$work/cache"
+            mkdir -p "$work/cache"
+            if ! ./netfs $flags -c "$work/cache" "$socket" "$mountpoint"; then
+                echo "netfs failed to mount in $mode mode" >&2
+                continue
+            fi
+            for pass in "${passes[@]}"; do
+                echo "Running $test ($pass) in $mode mode over $link..." >&2
+                if ./netfs_bench "$mountpoint" $test > "$report"; then
+                    echo "$link,$mode,$test,$pass,$(report_fields)" >> $result_file
+                else
+                    echo "$test failed in $mode mode over $link" >&2
+                    echo "$link,$mode,$test,$pass$(printf ',%.0s' "${fields[@]}")" >> $result_file
+                fi
+            done
+            $unmount -u "$mountpoint"
+        done
+    done
+
+    kill $server
+    wait $server 2> /dev/null
+    server=""
+done
+
+# Aligned table on stdout (column(1) isn't everywhere)
+awk -F, '{ for (i = 1; i <= NF; i++) { cell[NR, i] = $i; if (length($i) > width[i]) width[i] = length($i) } }
+         END { for (r = 1; r <= NR; r++) { for (i = 1; i <= NF; i++) printf "%-*s  ", width[i], cell[r, i]; printf "\n" } }' $result_file
+echo "Results written to $result_file"
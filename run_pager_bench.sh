@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# Run every workload under every pager and collect the -r reports into one
+# table. Usage: ./run_pager_bench.sh [workload...]   (default: ./workload_*)
+# REPS=n averages n runs per cell (default 3); COLD=1 drops the page cache
+# before each run; FLAGS passes extra pager options (FLAGS="-L thp").
+
+reps=${REPS:-3}
+pagers=("apager" "dpager" "hpager")
+fields=("wall_ns" "startup_ns" "minflt" "majflt" "maxrss_kb" "faults" "fault_ns" "huge_text_backed")
+
+if [ $# -gt 0 ]; then
+    workloads=("$@")
+else
+    workloads=($(ls workload_* 2> /dev/null | grep -v '\.c$'))
+fi
+if [ ${#workloads[@]} -eq 0 ]; then
+    echo "No workloads found; run 'make workloads' first." >&2
+    exit 1
+fi
+
+timestamp=$(date +"%Y%m%d_%H%M%S")
+result_file="bench_results_$timestamp.csv"
+report=$(mktemp)
+trap 'rm -f "$report"' EXIT
+
+(IFS=,; echo "Workload,Pager,Runs,${fields[*]}") > $result_file
+[ -n "$FLAGS" ] && echo "# pager flags: $FLAGS" >&2
+
+# Prints the averages of `fields` over `reps` runs, comma separated
+run_workload() {
+    local pager=$1
+    local workload=$2
+    local sums=()
+
+    for ((run = 0; run < reps; run++)); do
+        if [ -n "$COLD" ]; then
+            sync
+            echo 3 | sudo tee /proc/sys/vm/drop_caches > /dev/null
+        fi
+
+        if ! ./$pager -r "$report" $FLAGS ./$workload > /dev/null; then
+            echo "$workload failed under $pager" >&2
+            return 1
+        fi
+
+        for i in "${!fields[@]}"; do
+            value=$(awk -v key="${fields[$i]}" '$1 == key {print $2}' "$report")
+            sums[$i]=$(( ${sums[$i]:-0} + ${value:-0} ))
+        done
+    done
+
+    local averages=()
+    for i in "${!fields[@]}"; do
+        averages[$i]=$(( sums[$i] / reps ))
+    done
+    (IFS=,; echo "${averages[*]}")
+}
+
+for workload in "${workloads[@]}"; do
+    workload=${workload#./}
+    for pager in "${pagers[@]}"; do
+        echo "Running $workload under $pager..." >&2
+        if averages=$(run_workload $pager $workload); then
+            echo "$workload,$pager,$reps,$averages" >> $result_file
+        else
+            echo "$workload,$pager,0$(printf ',%.0s' "${fields[@]}")" >> $result_file
+        fi
+    done
+done
+
+# Aligned table on stdout (column(1) isn't everywhere)
+awk -F, '{ for (i = 1; i <= NF; i++) { cell[NR, i] = $i; if (length($i) > width[i]) width[i] = length($i) } }
+         END { for (r = 1; r <= NR; r++) { for (i = 1; i <= NF; i++) printf "%-*s  ", width[i], cell[r, i]; printf "\n" } }' $result_file
+echo "Results written to $result_file"
@@ -1,20 +1,420 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <dlfcn.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "alloctrace.h"
+#include "heapsample.h"
+
+// Allocation tracer, loaded with LD_PRELOAD=./sharedlib.so. Each malloc,
+// calloc, realloc and free appends a binary record to a ring buffer owned
+// by the calling thread (posix_memalign, aligned_alloc and memalign are
+// traced as malloc); a drain thread copies the rings to
+// $ALLOCTRACE_FILE.<pid> (alloctrace.<pid> by default; exec'd children
+// inherit LD_PRELOAD and get files of their own) and an exit handler
+// drains what is left. The allocation path takes no locks and never calls
+// into stdio. alloctrace_report summarizes the file.
+//
+// ALLOCTRACE_SAMPLE=n profiles instead of tracing: about one allocation
+// per n bytes is sampled with its call stack (see heapsample.h). SIGUSR2
+// writes the heap in use to <file>.heap.<k> as folded stacks; at exit the
+// rest goes to <file>.heap and a leak report to <file>.leaks.
+//
+// ALLOCTRACE_POISON=1 fills new blocks with MAGIC, as this file used to.
 
 #define MAGIC 0xCC
+#define RING_RECORDS 65536              // per thread; a power of two
+#define DRAIN_INTERVAL_NS (10 * 1000 * 1000)
+#define BOOTSTRAP_SIZE (64 * 1024)
+
+// Single producer (the owning thread), single consumer (whoever holds
+// drain_lock). A thread that fills half its ring drains it itself if the
+// lock is free; a full ring drops records rather than block the program.
+struct ring {
+    _Atomic uint64_t head;      // next record the owner writes
+    _Atomic uint64_t tail;      // next record to drain
+    _Atomic uint64_t dropped;
+    _Atomic int owned;          // a live thread writes here; freed rings are reused
+    uint32_t tid;               // the last owner
+    struct ring *next;          // every ring ever made, newest first
+    struct trace_record records[RING_RECORDS];
+};
+
+static void *(*real_malloc)(size_t);
+static void (*real_free)(void *);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+
+// dlsym allocates, so the lookups themselves are served from here
+static char bootstrap[BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static _Atomic size_t bootstrap_used;
+
+static _Atomic(struct ring *) rings;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static int trace_fd = -1;
+static int poison;
+static _Atomic int tracing;             // tracing or sampling is on
+static int sampling;
+static _Atomic int dump_requested;
+static int dump_count;
+static char trace_name[256];
+
+// initial-exec: the default model can call malloc on first access
+static __thread struct ring *my_ring __attribute__((tls_model("initial-exec")));
+static __thread int resolving __attribute__((tls_model("initial-exec")));
+static __thread int inside __attribute__((tls_model("initial-exec")));   // no tracing our own calls
+static __thread int exiting __attribute__((tls_model("initial-exec")));  // ring handed back
+
+static void resolve(void) {
+    resolving = 1;
+    real_malloc = dlsym(RTLD_NEXT, "malloc");
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    resolving = 0;
+}
+
+// Bootstrap blocks are never freed; each carries its size for realloc
+static void *bootstrap_alloc(size_t size) {
+    size_t need = (size + 16 + 15) & ~(size_t)15;
+    size_t start = atomic_fetch_add(&bootstrap_used, need);
+    if (start + need > BOOTSTRAP_SIZE) return NULL;
+    *(size_t *)(bootstrap + start) = size;
+    return bootstrap + start + 16;
+}
+
+static int from_bootstrap(const void *p) {
+    return (const char *)p >= bootstrap && (const char *)p < bootstrap + BOOTSTRAP_SIZE;
+}
+
+// Once the ring is handed back another thread may take it, so calls made
+// later in this thread's exit go unrecorded
+static void release_ring(void *arg) {
+    struct ring *r = arg;
+    my_ring = NULL;
+    exiting = 1;
+    atomic_store(&r->owned, 0);
+}
+
+// The calling thread's ring: a free one if any, else a new one
+static struct ring *get_ring(void) {
+    if (my_ring) return my_ring;
+
+    inside = 1;
+    uint32_t tid = gettid();
+    struct ring *r;
+    for (r = atomic_load(&rings); r; r = r->next) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&r->owned, &expected, 1)) break;
+    }
+    if (!r) {
+        r = mmap(NULL, sizeof(*r), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (r == MAP_FAILED) {
+            inside = 0;
+            return NULL;
+        }
+        r->owned = 1;
+        r->next = atomic_load(&rings);
+        while (!atomic_compare_exchange_weak(&rings, &r->next, r)) {
+        }
+    }
+    r->tid = tid;
+    pthread_setspecific(ring_key, r);
+    my_ring = r;
+    inside = 0;
+    return r;
+}
+
+// Copy what `r` holds to the trace file. Called with drain_lock held.
+static void drain_ring(struct ring *r) {
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    while (tail != head) {
+        // Up to the end of the buffer, then from its start
+        uint64_t index = tail & (RING_RECORDS - 1);
+        uint64_t n = head - tail < RING_RECORDS - index ? head - tail : RING_RECORDS - index;
+        if (write(trace_fd, &r->records[index], n * sizeof(struct trace_record)) < 0) {
+            // Skip what can't be written rather than stall the program
+        }
+        tail += n;
+    }
+    atomic_store_explicit(&r->tail, tail, memory_order_release);
+}
+
+static void drain(void) {
+    for (struct ring *r = atomic_load(&rings); r; r = r->next) {
+        drain_ring(r);
+    }
+}
+
+static void trace(uint32_t op, const void *ptr, const void *old, size_t size) {
+    if (!atomic_load_explicit(&tracing, memory_order_relaxed) || inside || exiting) return;
+    struct ring *r = get_ring();
+    if (!r) return;
+
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&r->tail, memory_order_acquire) == RING_RECORDS) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct trace_record *rec = &r->records[head & (RING_RECORDS - 1)];
+    rec->ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    rec->ptr = (uintptr_t)ptr;
+    rec->old = (uintptr_t)old;
+    rec->size = size;
+    rec->tid = r->tid;
+    rec->op = op;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    // Allocation-heavy threads can outrun the drain thread
+    if (head + 1 - atomic_load_explicit(&r->tail, memory_order_relaxed) >= RING_RECORDS / 2 &&
+        pthread_mutex_trylock(&drain_lock) == 0) {
+        if (atomic_load(&tracing)) drain_ring(r);
+        pthread_mutex_unlock(&drain_lock);
+    }
+}
+
+static void dump_heap(void) {
+    char path[300];
+    snprintf(path, sizeof(path), "%s.heap.%d", trace_name, ++dump_count);
+    if (sample_dump(path, 0) != 0) perror(path);
+}
+
+// Dumping takes locks and allocates, so the drain thread does it
+static void request_dump(int sig) {
+    (void) sig;
+    atomic_store(&dump_requested, 1);
+}
+
+static void *drain_thread(void *arg) {
+    (void) arg;
+
+    inside = 1;
+    struct timespec interval = { 0, DRAIN_INTERVAL_NS };
+    for (;;) {
+        nanosleep(&interval, NULL);
+        if (sampling) {
+            if (atomic_exchange(&dump_requested, 0) && atomic_load(&tracing)) dump_heap();
+            continue;
+        }
+        pthread_mutex_lock(&drain_lock);
+        if (atomic_load(&tracing)) drain();
+        pthread_mutex_unlock(&drain_lock);
+    }
+    return NULL;
+}
+
+// A forked child would write into the parent's file; it goes untraced
+static void stop_in_child(void) {
+    atomic_store(&tracing, 0);
+}
+
+__attribute__((constructor)) static void trace_start(void) {
+    if (!real_malloc) resolve();
+    poison = getenv("ALLOCTRACE_POISON") != NULL;
+
+    const char *name = getenv("ALLOCTRACE_FILE");
+    snprintf(trace_name, sizeof(trace_name), "%s.%d", name ? name : "alloctrace", getpid());
+    name = trace_name;
+
+    const char *mean = getenv("ALLOCTRACE_SAMPLE");
+    if (mean && strtod(mean, NULL) > 0) {
+        inside = 1;
+        sample_init(strtod(mean, NULL));
+        inside = 0;
+        sampling = 1;
+        signal(SIGUSR2, request_dump);
+    } else {
+        trace_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (trace_fd < 0) {
+            perror(name);
+            return;
+        }
+        struct trace_header header = { TRACE_MAGIC, TRACE_VERSION, sizeof(struct trace_record), getpid() };
+        if (write(trace_fd, &header, sizeof(header)) != sizeof(header)) {
+            perror(name);
+            return;
+        }
+    }
+
+    pthread_key_create(&ring_key, release_ring);
+    pthread_atfork(NULL, NULL, stop_in_child);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, drain_thread, NULL) != 0) {
+        perror("pthread_create");
+    } else {
+        pthread_detach(thread);
+    }
+    atomic_store(&tracing, 1);
+}
+
+__attribute__((destructor)) static void trace_stop(void) {
+    if (!atomic_load(&tracing)) return;
+
+    if (sampling) {
+        inside = 1;
+        atomic_store(&tracing, 0);
+        char path[300];
+        snprintf(path, sizeof(path), "%s.heap", trace_name);
+        if (sample_dump(path, 0) != 0) perror(path);
+        snprintf(path, sizeof(path), "%s.leaks", trace_name);
+        if (sample_dump(path, 1) != 0) perror(path);
+        return;
+    }
+
+    pthread_mutex_lock(&drain_lock);
+    atomic_store(&tracing, 0);
+    drain();
+    for (struct ring *r = atomic_load(&rings); r; r = r->next) {
+        struct trace_record rec = { .size = atomic_load(&r->dropped), .tid = r->tid, .op = TRACE_DROPPED };
+        if (rec.size && write(trace_fd, &rec, sizeof(rec)) < 0) break;
+    }
+    close(trace_fd);
+    pthread_mutex_unlock(&drain_lock);
+}
+
+// Trace the call, or in sampling mode maybe sample it. Inlined so that a
+// sample's stack starts at the allocator entry point.
+static inline __attribute__((always_inline)) void note(uint32_t op, void *p, void *old, size_t size) {
+    if (!sampling) {
+        trace(op, p, old, size);
+        return;
+    }
+    if (p && !inside && atomic_load_explicit(&tracing, memory_order_relaxed) && sample_due(size)) {
+        inside = 1;
+        sample_record(p, size);
+        inside = 0;
+    }
+}
 
 void *malloc(size_t size) {
-    void *(*real_malloc)(size_t) = dlsym(RTLD_NEXT, "malloc");
-  
+    if (!real_malloc) {
+        if (resolving) return bootstrap_alloc(size);
+        resolve();
+    }
+
     void *p = real_malloc(size);
-  
-    printf("malloc(%zu) returned %p\n", size, p);
+    note(TRACE_MALLOC, p, NULL, size);
+    if (p && poison) {
+        memset(p, MAGIC, size);
+    }
+    return p;
+}
+
+void *calloc(size_t count, size_t size) {
+    if (!real_calloc) {
+        // The bootstrap buffer starts out zeroed and is never reused
+        if (resolving) return count && size > SIZE_MAX / count ? NULL : bootstrap_alloc(count * size);
+        resolve();
+    }
+
+    void *p = real_calloc(count, size);
+    note(TRACE_CALLOC, p, NULL, count * size);
+    return p;
+}
 
-    if (p) {
+void *realloc(void *old, size_t size) {
+    if (old && from_bootstrap(old)) {
+        void *p = malloc(size);
+        size_t old_size = *(size_t *)((char *)old - 16);
+        if (p) memcpy(p, old, old_size < size ? old_size : size);
+        return p;
+    }
+    if (!real_realloc) {
+        if (resolving) return bootstrap_alloc(size);
+        resolve();
+    }
+
+    // Take the old block's sample out first: once real_realloc frees it,
+    // another thread can be handed the address and sample it
+    struct sample *taken = sampling && old && !inside ? sample_take(old) : NULL;
+    void *p = real_realloc(old, size);
+    if (taken) {
+        // A failed realloc leaves `old` live; realloc(old, 0) returns NULL
+        // having freed it
+        if (p || size == 0) {
+            real_free(taken);
+        } else {
+            sample_restore(taken);
+        }
+    }
+    note(TRACE_REALLOC, p, old, size);
+    return p;
+}
+
+// The bootstrap buffer only guarantees 16-byte alignment, so aligned
+// requests made while resolving just fail
+int posix_memalign(void **out, size_t alignment, size_t size) {
+    if (!real_posix_memalign) {
+        if (resolving) return ENOMEM;
+        resolve();
+    }
+
+    int res = real_posix_memalign(out, alignment, size);
+    if (res == 0) {
+        note(TRACE_MALLOC, *out, NULL, size);
+        if (poison) memset(*out, MAGIC, size);
+    }
+    return res;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    if (!real_aligned_alloc) {
+        if (resolving) return NULL;
+        resolve();
+    }
+
+    void *p = real_aligned_alloc(alignment, size);
+    note(TRACE_MALLOC, p, NULL, size);
+    if (p && poison) {
         memset(p, MAGIC, size);
     }
     return p;
 }
+
+void *memalign(size_t alignment, size_t size) {
+    if (!real_memalign) {
+        if (resolving) return NULL;
+        resolve();
+    }
+
+    void *p = real_memalign(alignment, size);
+    note(TRACE_MALLOC, p, NULL, size);
+    if (p && poison) {
+        memset(p, MAGIC, size);
+    }
+    return p;
+}
+
+void free(void *p) {
+    if (!p || from_bootstrap(p)) return;
+    if (!real_free) resolve();
+
+    if (sampling) {
+        // The profiler's own blocks are never sampled, and it may be
+        // holding a stripe lock
+        if (!inside) sample_forget(p);
+    } else {
+        trace(TRACE_FREE, p, NULL, 0);
+    }
+    real_free(p);
+}
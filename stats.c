@@ -0,0 +1,101 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+struct pager_stats *stats = NULL;
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stats_fault(uint64_t start) {
+    if (!stats) return;
+    stats->faults++;
+    stats->fault_ns += now_ns() - start;
+}
+
+static uint64_t timeval_ns(struct timeval tv) {
+    return tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+}
+
+// One "name value" pair per line, like /proc/<pid>/io
+static void write_report(FILE *out, const char *pager, const char *program,
+                         int status, uint64_t wall_ns, const struct rusage *usage) {
+    fprintf(out, "pager %s\n", pager);
+    fprintf(out, "program %s\n", program);
+    fprintf(out, "exit_status %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+    fprintf(out, "startup_ns %lu\n", stats->startup_ns);
+    fprintf(out, "wall_ns %lu\n", wall_ns);
+    fprintf(out, "user_ns %lu\n", timeval_ns(usage->ru_utime));
+    fprintf(out, "sys_ns %lu\n", timeval_ns(usage->ru_stime));
+    fprintf(out, "faults %lu\n", stats->faults);
+    fprintf(out, "fault_ns %lu\n", stats->fault_ns);
+    fprintf(out, "file_bytes_read %lu\n", stats->file_bytes_read);
+    fprintf(out, "file_bytes_mapped %lu\n", stats->file_bytes_mapped);
+    fprintf(out, "clusters_decompressed %lu\n", stats->clusters_decompressed);
+    fprintf(out, "compressed_bytes_read %lu\n", stats->compressed_bytes_read);
+    fprintf(out, "plan_hit %d\n", stats->plan_hit);
+    fprintf(out, "plan_hot_pages %lu\n", stats->plan_hot_pages);
+    fprintf(out, "populate_threads %d\n", stats->populate_threads);
+    fprintf(out, "populate_chunks %lu\n", stats->populate_chunks);
+    fprintf(out, "populate_ns %lu\n", stats->populate_ns);
+    fprintf(out, "huge_text_bytes %lu\n", stats->huge_text_bytes);
+    fprintf(out, "huge_text_backed %lu\n", stats->huge_text_backed);
+    fprintf(out, "minflt %ld\n", usage->ru_minflt);
+    fprintf(out, "majflt %ld\n", usage->ru_majflt);
+    fprintf(out, "maxrss_kb %ld\n", usage->ru_maxrss);
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < stats->segment_count[i]; j++) {
+            fprintf(out, "image%d_segment%d_vaddr 0x%lx\n", i, j, stats->segment_vaddr[i][j]);
+            fprintf(out, "image%d_segment%d_pages %lu\n", i, j, stats->segment_pages[i][j]);
+        }
+    }
+}
+
+void stats_start(const char *pager, const char *program, const char *path) {
+    stats = mmap(NULL, sizeof(*stats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    stats->start_ns = now_ns();
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) return;
+
+    // Like system(): let the program handle terminal signals
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t wall_ns = now_ns() - stats->start_ns;
+
+    FILE *out = stderr;
+    if (strcmp(path, "-") != 0 && !(out = fopen(path, "w"))) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    write_report(out, pager, program, status, wall_ns, &usage);
+    if (out != stderr) fclose(out);
+
+    exit(WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+}
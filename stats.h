@@ -0,0 +1,42 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include "loader.h"
+
+// Pager counters. They live in shared memory so the process that reports
+// them survives the loaded program, whose exit never returns to us.
+struct pager_stats {
+    uint64_t start_ns;                          // when the loader started
+    uint64_t startup_ns;                        // loader start to the entry-point jump
+    uint64_t faults;                            // faults resolved by the handler
+    uint64_t fault_ns;                          // time spent resolving them
+    uint64_t file_bytes_read;                   // copied from the ELF files with pread
+    uint64_t file_bytes_mapped;                 // mapped straight from the ELF files
+    uint64_t clusters_decompressed;             // packed executables only
+    uint64_t compressed_bytes_read;
+    int plan_hit;                               // loaded from a cached load plan
+    uint64_t plan_hot_pages;                    // hot pages the plan had recorded
+    int populate_threads;                       // apager -j: threads that populated segments
+    uint64_t populate_chunks;
+    uint64_t populate_ns;                       // time until every chunk was resident
+    uint64_t huge_text_bytes;                   // -L: text copied to huge-page-backed memory
+    uint64_t huge_text_backed;                  // how much of it the kernel put on huge pages
+    int segment_count[2];                       // per image: program, interpreter
+    uint64_t segment_vaddr[2][MAX_PHDR_COUNT];
+    uint64_t segment_pages[2][MAX_PHDR_COUNT];  // pages mapped per segment
+};
+
+extern struct pager_stats *stats;   // NULL unless a report was requested
+
+uint64_t now_ns(void);
+
+// Turn on instrumentation. The loader forks: the child returns and goes on to
+// load and run the program, the parent waits for it, writes the report to
+// `path` ("-" for stderr) and exits with the child's status.
+void stats_start(const char *pager, const char *program, const char *path);
+
+// Account a fault the handler resolved, timed from `start` (a now_ns() value)
+void stats_fault(uint64_t start);
+
+#endif
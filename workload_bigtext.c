@@ -0,0 +1,41 @@
+// Workload: 4 MB of .text, 4096 functions of 1 KB each, all called once,
+// or once per round with a round count argument (for iTLB pressure)
+#include <stdio.h>
+#include <stdlib.h>
+
+// Each function slides through 1 KB of nops before returning
+#define F(n) \
+    __attribute__((noinline)) static unsigned long f##n(unsigned long x) { \
+        __asm__ volatile(".fill 1024, 1, 0x90"); \
+        return x * 31 + n; \
+    }
+#define F4(n) F(n##0) F(n##1) F(n##2) F(n##3)
+#define F16(n) F4(n##0) F4(n##1) F4(n##2) F4(n##3)
+#define F256(n) F16(n##0) F16(n##1) F16(n##2) F16(n##3) F16(n##4) F16(n##5) F16(n##6) F16(n##7) \
+                F16(n##8) F16(n##9) F16(n##a) F16(n##b) F16(n##c) F16(n##d) F16(n##e) F16(n##f)
+#define F4096 F256(0x0) F256(0x1) F256(0x2) F256(0x3) F256(0x4) F256(0x5) F256(0x6) F256(0x7) \
+              F256(0x8) F256(0x9) F256(0xa) F256(0xb) F256(0xc) F256(0xd) F256(0xe) F256(0xf)
+
+#define P(n) f##n,
+#define P4(n) P(n##0) P(n##1) P(n##2) P(n##3)
+#define P16(n) P4(n##0) P4(n##1) P4(n##2) P4(n##3)
+#define P256(n) P16(n##0) P16(n##1) P16(n##2) P16(n##3) P16(n##4) P16(n##5) P16(n##6) P16(n##7) \
+                P16(n##8) P16(n##9) P16(n##a) P16(n##b) P16(n##c) P16(n##d) P16(n##e) P16(n##f)
+#define P4096 P256(0x0) P256(0x1) P256(0x2) P256(0x3) P256(0x4) P256(0x5) P256(0x6) P256(0x7) \
+              P256(0x8) P256(0x9) P256(0xa) P256(0xb) P256(0xc) P256(0xd) P256(0xe) P256(0xf)
+
+F4096
+
+static unsigned long (*functions[])(unsigned long) = { P4096 };
+
+int main(int argc, char *argv[]) {
+    unsigned long x = 1;
+    int rounds = argc > 1 ? atoi(argv[1]) : 1;
+    for (int round = 0; round < rounds; round++) {
+        for (unsigned long i = 0; i < sizeof(functions) / sizeof(functions[0]); i++) {
+            x = functions[i](x);
+        }
+    }
+    printf("Result: %lu\n", x);
+    return 0;
+}
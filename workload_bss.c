@@ -0,0 +1,20 @@
+// Workload: write then read back every page of a 256 MB .bss
+#include <stdio.h>
+
+#define ARRAY_SIZE (256UL * 1024 * 1024)
+#define PAGE 4096
+
+char array[ARRAY_SIZE];
+
+int main() {
+    for (unsigned long i = 0; i < ARRAY_SIZE; i += PAGE) {
+        array[i] = (char)(i / PAGE);
+    }
+
+    long sum = 0;
+    for (unsigned long i = 0; i < ARRAY_SIZE; i += PAGE) {
+        sum += array[i];
+    }
+    printf("Sum: %ld\n", sum);
+    return 0;
+}
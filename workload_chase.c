@@ -0,0 +1,31 @@
+// Workload: pointer chasing through a random cycle over a 64 MB .bss
+#include <stdio.h>
+
+#define NODES (8 * 1024 * 1024)
+#define STEPS (4 * 1024 * 1024)
+
+unsigned long next[NODES];
+
+int main() {
+    // Sattolo's algorithm: a random permutation that is a single cycle
+    for (unsigned long i = 0; i < NODES; i++) {
+        next[i] = i;
+    }
+    unsigned long x = 88172645463325252UL;
+    for (unsigned long i = NODES - 1; i > 0; i--) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        unsigned long j = x % i;
+        unsigned long tmp = next[i];
+        next[i] = next[j];
+        next[j] = tmp;
+    }
+
+    unsigned long node = 0;
+    for (int i = 0; i < STEPS; i++) {
+        node = next[node];
+    }
+    printf("Last node: %lu\n", node);
+    return 0;
+}
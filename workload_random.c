@@ -0,0 +1,21 @@
+// Workload: random reads from a 64 MB table initialized in .data
+#include <stdio.h>
+
+#define TABLE_SIZE (64 * 1024 * 1024)
+#define READS (1024 * 1024)
+
+unsigned char table[TABLE_SIZE] = {1};
+
+int main() {
+    unsigned long sum = 0;
+    unsigned long x = 88172645463325252UL;
+    for (int i = 0; i < READS; i++) {
+        // xorshift64
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sum += table[x % TABLE_SIZE];
+    }
+    printf("Sum: %lu\n", sum);
+    return 0;
+}
@@ -0,0 +1,15 @@
+// Workload: sequential scan over a 64 MB table initialized in .data
+#include <stdio.h>
+
+#define TABLE_SIZE (64 * 1024 * 1024)
+
+unsigned char table[TABLE_SIZE] = {1};
+
+int main() {
+    unsigned long sum = 0;
+    for (unsigned long i = 0; i < TABLE_SIZE; i += 64) {
+        sum += table[i];
+    }
+    printf("Sum: %lu\n", sum);
+    return 0;
+}
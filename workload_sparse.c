@@ -0,0 +1,20 @@
+// Workload: a 1 GB .bss of which only one page per megabyte is touched
+#include <stdio.h>
+
+#define ARRAY_SIZE (1024UL * 1024 * 1024)
+#define STRIDE (1024 * 1024)
+
+char array[ARRAY_SIZE];
+
+int main() {
+    for (unsigned long i = 0; i < ARRAY_SIZE; i += STRIDE) {
+        array[i] = 1;
+    }
+
+    unsigned long sum = 0;
+    for (unsigned long i = 0; i < ARRAY_SIZE; i += STRIDE) {
+        sum += array[i];
+    }
+    printf("Touched pages: %lu\n", sum);
+    return 0;
+}